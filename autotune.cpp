@@ -0,0 +1,247 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "autotune.h"
+#include "cl_handle.h"
+#include "devices.h"
+#include "program_cache.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Smallest local size tried; below this most devices leave SIMD lanes idle.
+const size_t kMinLocalSize = 16;
+
+const unsigned int kElementsPerItem[] = { 1, 2, 4, 8, 16 };
+
+// Median device time of `repetitions` launches with the engine's current
+// configuration, after one untimed warmup launch.
+double time_kernel(OpenCLEngine& engine, cl_command_queue queue, cl_mem c, cl_mem a, cl_mem b, size_t N, size_t repetitions)
+{
+  engine.enqueue_add(queue, c, a, b, N, 0, NULL, NULL);
+  clFinish(queue);
+
+  std::vector<double> samples;
+  for (size_t r = 0; r < repetitions; r++) {
+    EventHandle event;
+    engine.enqueue_add(queue, c, a, b, N, 0, NULL, event.out());
+    cl_event kernel = event.get();
+    check_cl(clWaitForEvents(1, &kernel), "clWaitForEvents");
+    samples.push_back(stage_timing(kernel).run_seconds());
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+bool kernel_from_name(const std::string& name, AddKernel* kernel)
+{
+  for (size_t i = 0; i < ADD_KERNEL_COUNT; i++) {
+    if (name == add_kernel_name((AddKernel)i)) {
+      *kernel = (AddKernel)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool faster(const TuningResult& lhs, const TuningResult& rhs)
+{
+  return lhs.seconds < rhs.seconds;
+}
+
+} // namespace
+
+std::vector<TuningResult> autotune(OpenCLEngine& engine, size_t N, size_t repetitions)
+{
+  if (repetitions == 0) {
+    repetitions = 1;
+  }
+
+  // Candidates: every kernel, with the coarsened one at each factor.
+  std::vector<TuningConfig> kernels;
+  for (size_t i = ADD_SCALAR; i <= ADD_INT16; i++) {
+    TuningConfig config = { (AddKernel)i, 0, engine.elements_per_item() };
+    kernels.push_back(config);
+  }
+  for (size_t i = 0; i < sizeof(kElementsPerItem) / sizeof(kElementsPerItem[0]); i++) {
+    TuningConfig config = { ADD_COARSE, 0, kElementsPerItem[i] };
+    kernels.push_back(config);
+  }
+
+  BufferPool& pool = engine.pool();
+  QueueHandle queue(engine.create_queue(CL_QUEUE_PROFILING_ENABLE));
+  PooledBuffer a(pool, sizeof(int) * N, CL_MEM_READ_ONLY);
+  PooledBuffer b(pool, sizeof(int) * N, CL_MEM_READ_ONLY);
+  PooledBuffer c(pool, sizeof(int) * N, CL_MEM_WRITE_ONLY);
+  QueueFinish finish(queue.get());
+
+  // The inputs' contents don't affect the timing of an add, so they are
+  // left as whatever the pool hands out.
+  std::vector<TuningResult> results;
+  for (size_t k = 0; k < kernels.size(); k++) {
+    engine.set_elements_per_item(kernels[k].elements_per_item);
+    engine.set_add_kernel(kernels[k].kernel);
+
+    // Powers of two up to the kernel's limit, plus the limit itself.
+    size_t max_local = engine.max_local_size(kernels[k].kernel);
+    std::vector<size_t> local_sizes;
+    for (size_t local = std::min(kMinLocalSize, max_local); local < max_local; local *= 2) {
+      local_sizes.push_back(local);
+    }
+    local_sizes.push_back(max_local);
+
+    for (size_t l = 0; l < local_sizes.size(); l++) {
+      engine.set_local_size(local_sizes[l]);
+      TuningResult result;
+      result.config = kernels[k];
+      result.config.local_size = local_sizes[l];
+      result.seconds = time_kernel(engine, queue.get(), c.get(), a.get(), b.get(), N, repetitions);
+      results.push_back(result);
+    }
+  }
+
+  std::stable_sort(results.begin(), results.end(), faster);
+  apply_tuning(engine, results.front().config);
+  return results;
+}
+
+std::string tuning_file_path(const std::string& directory, cl_device_id device)
+{
+  std::string key = device_string(device, CL_DEVICE_NAME) + ";" + device_string(device, CL_DRIVER_VERSION);
+  std::ostringstream path;
+  path << directory << "/tuning-" << std::hex << fnv1a_hash(key) << ".txt";
+  return path.str();
+}
+
+bool save_tuning(const std::string& path, size_t N, const TuningConfig& config)
+{
+  // Keep the other sizes' entries, one line per N.
+  std::map<size_t, std::string> entries;
+  {
+    std::ifstream in(path.c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+      std::istringstream fields(line);
+      size_t entry_N = 0;
+      if (fields >> entry_N) {
+        entries[entry_N] = line;
+      }
+    }
+  }
+
+  std::ostringstream line;
+  line << N << " " << add_kernel_name(config.kernel) << " " << config.local_size << " " << config.elements_per_item;
+  entries[N] = line.str();
+
+  size_t slash = path.rfind('/');
+  if (slash != std::string::npos && slash > 0 && !make_directories(path.substr(0, slash))) {
+    return false;
+  }
+
+  std::string temp_path = temp_file_path(path);
+  {
+    std::ofstream out(temp_path.c_str(), std::ios::trunc);
+    for (std::map<size_t, std::string>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+      out << it->second << "\n";
+    }
+    // Buffered data only reaches the file on close, so a short write
+    // (e.g. a full disk) shows up there and not before.
+    out.close();
+    if (out.fail()) {
+      remove(temp_path.c_str());
+      return false;
+    }
+  }
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool load_tuning(const std::string& path, size_t N, TuningConfig* config)
+{
+  std::ifstream in(path.c_str());
+  bool found = false;
+  double best_distance = 0.0;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    size_t entry_N = 0;
+    std::string kernel_name;
+    TuningConfig entry;
+    if (!(fields >> entry_N >> kernel_name >> entry.local_size >> entry.elements_per_item) || entry_N == 0 ||
+        !kernel_from_name(kernel_name, &entry.kernel)) {
+      continue;
+    }
+
+    double distance = fabs(log((double)entry_N / (double)std::max(N, (size_t)1)));
+    if (!found || distance < best_distance) {
+      *config = entry;
+      best_distance = distance;
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool apply_tuning(OpenCLEngine& engine, const TuningConfig& config)
+{
+  if (config.kernel >= ADD_KERNEL_COUNT || config.elements_per_item == 0) {
+    return false;
+  }
+
+  // The kernel's work-group limit can depend on ELEMENTS_PER_ITEM, so it is
+  // only known after the rebuild.
+  unsigned int previous_elements_per_item = engine.elements_per_item();
+  engine.set_elements_per_item(config.elements_per_item);
+  if (config.local_size == 0 || config.local_size > engine.max_local_size(config.kernel)) {
+    engine.set_elements_per_item(previous_elements_per_item);
+    return false;
+  }
+  engine.set_add_kernel(config.kernel);
+  engine.set_local_size(config.local_size);
+  return true;
+}
+
+std::string describe(const TuningConfig& config)
+{
+  std::ostringstream text;
+  text << add_kernel_name(config.kernel);
+  if (config.kernel == ADD_COARSE) {
+    text << " x" << config.elements_per_item;
+  }
+  text << ", local size " << config.local_size;
+  return text.str();
+}
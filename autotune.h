@@ -0,0 +1,73 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef AUTOTUNE_H__
+#define AUTOTUNE_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "opencl_engine.h"
+
+// One point in the tuning space of the add kernels.
+struct TuningConfig {
+    AddKernel       kernel;
+    size_t          local_size;
+    unsigned int    elements_per_item;  // only meaningful for ADD_COARSE
+};
+
+struct TuningResult {
+    TuningConfig    config;
+    double          seconds;            // median kernel time from profiling events
+};
+
+// Sweeps kernel variants (scalar, int4/8/16, coarsened with 1-16 elements
+// per item) and power-of-two local sizes for an N-element add on the
+// engine's device. Each configuration is timed from CL_PROFILING_COMMAND_START
+// to _END on a profiling queue, so only device time counts. Returns every
+// result, fastest first, and leaves the engine set to the fastest.
+std::vector<TuningResult> autotune(OpenCLEngine& engine, size_t N, size_t repetitions = 5);
+
+// Per-device tuning file inside `directory`, named after the device and
+// driver so a driver update starts from scratch.
+std::string tuning_file_path(const std::string& directory, cl_device_id device);
+
+// Records `config` as the best choice for N, replacing any entry for the
+// same N. Returns false if the file can't be written.
+bool save_tuning(const std::string& path, size_t N, const TuningConfig& config);
+
+// Loads the entry whose N is closest (by ratio) to the requested N.
+bool load_tuning(const std::string& path, size_t N, TuningConfig* config);
+
+// Applies `config` to the engine. Returns false, leaving the kernel choice
+// alone, if the config doesn't fit the device (e.g. a stale local size).
+bool apply_tuning(OpenCLEngine& engine, const TuningConfig& config);
+
+std::string describe(const TuningConfig& config);
+
+#endif // AUTOTUNE_H__
@@ -0,0 +1,188 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "batcher.h"
+#include "cl_handle.h"
+#include "opencl_engine.h"
+
+#include <algorithm>
+#include <string.h>
+#include <stdexcept>
+
+AddBatcher::AddBatcher(OpenCLEngine& engine, const BatcherConfig& config)
+: m_engine(engine)
+, m_config(config)
+, m_queue(engine.create_queue())
+, m_pending_elements(0)
+, m_stop(false)
+{
+  m_config.max_jobs = std::max(m_config.max_jobs, (size_t)1);
+  m_worker = std::thread(&AddBatcher::worker, this);
+}
+
+AddBatcher::~AddBatcher()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  m_worker.join();
+}
+
+std::future<void> AddBatcher::submit(int* c, const int* a, const int* b, size_t N)
+{
+  Job job;
+  job.c = c;
+  job.a = a;
+  job.b = b;
+  job.N = N;
+  job.submitted = Clock::now();
+  std::future<void> result = job.done.get_future();
+
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stop) {
+      throw std::logic_error("AddBatcher::submit: batcher is shutting down");
+    }
+    m_pending.push_back(std::move(job));
+    m_pending_elements += N;
+    // The worker only needs to know about the first job (to start the wait
+    // clock) and about the one that fills the batch.
+    wake = m_pending.size() == 1 || batch_full();
+  }
+  if (wake) {
+    m_wake.notify_one();
+  }
+  return result;
+}
+
+BatcherStats AddBatcher::stats()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+bool AddBatcher::batch_full() const
+{
+  return m_pending.size() >= m_config.max_jobs || m_pending_elements >= m_config.max_elements;
+}
+
+void AddBatcher::worker()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_wake.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+    if (m_pending.empty()) {
+      return;
+    }
+
+    // Give other callers until the oldest job's deadline to join the batch.
+    Clock::time_point deadline = m_pending.front().submitted +
+                                 std::chrono::duration_cast<Clock::duration>(
+                                   std::chrono::duration<double>(m_config.max_wait_seconds));
+    m_wake.wait_until(lock, deadline, [this]() { return m_stop || batch_full(); });
+
+    // Take jobs in order up to the limits, but always at least one.
+    std::vector<Job> jobs;
+    size_t elements = 0;
+    while (!m_pending.empty() && jobs.size() < m_config.max_jobs &&
+           (jobs.empty() || elements + m_pending.front().N <= m_config.max_elements)) {
+      elements += m_pending.front().N;
+      m_pending_elements -= m_pending.front().N;
+      jobs.push_back(std::move(m_pending.front()));
+      m_pending.pop_front();
+    }
+
+    m_stats.batches++;
+    m_stats.jobs += jobs.size();
+    m_stats.elements += elements;
+    lock.unlock();
+    run_batch(jobs);
+    lock.lock();
+  }
+}
+
+void AddBatcher::run_batch(std::vector<Job>& jobs)
+{
+  m_offsets.assign(1, 0);
+  for (size_t i = 0; i < jobs.size(); i++) {
+    m_offsets.push_back(m_offsets.back() + jobs[i].N);
+  }
+  size_t total = m_offsets.back();
+
+  BufferPool& pool = m_engine.pool();
+  cl_command_queue queue = m_queue.get();
+  try {
+    if (total > 0) {
+      if (m_staging_a.size() < total) {
+        m_staging_a.resize(total);
+        m_staging_b.resize(total);
+        m_staging_c.resize(total);
+      }
+      for (size_t i = 0; i < jobs.size(); i++) {
+        memcpy(&m_staging_a[m_offsets[i]], jobs[i].a, sizeof(int) * jobs[i].N);
+        memcpy(&m_staging_b[m_offsets[i]], jobs[i].b, sizeof(int) * jobs[i].N);
+      }
+
+      size_t bytes = sizeof(int) * total;
+      PooledBuffer a(pool, bytes, CL_MEM_READ_ONLY);
+      PooledBuffer b(pool, bytes, CL_MEM_READ_ONLY);
+      PooledBuffer c(pool, bytes, CL_MEM_WRITE_ONLY);
+      EventHandle writes[2], kernel;
+      QueueFinish finish(queue);
+
+      check_cl(clEnqueueWriteBuffer(queue, a.get(), CL_FALSE, 0, bytes, &m_staging_a[0], 0, NULL, writes[0].out()),
+               "clEnqueueWriteBuffer");
+      check_cl(clEnqueueWriteBuffer(queue, b.get(), CL_FALSE, 0, bytes, &m_staging_b[0], 0, NULL, writes[1].out()),
+               "clEnqueueWriteBuffer");
+
+      // The add is elementwise, so packed segments need no per-segment
+      // bounds: one launch over the whole range computes every job.
+      cl_event wait_list[2] = { writes[0].get(), writes[1].get() };
+      m_engine.enqueue_add(queue, c.get(), a.get(), b.get(), total, 2, wait_list, kernel.out());
+
+      cl_event kernel_event = kernel.get();
+      check_cl(clEnqueueReadBuffer(queue, c.get(), CL_TRUE, 0, bytes, &m_staging_c[0], 1, &kernel_event, NULL),
+               "clEnqueueReadBuffer");
+
+      for (size_t i = 0; i < jobs.size(); i++) {
+        memcpy(jobs[i].c, &m_staging_c[m_offsets[i]], sizeof(int) * jobs[i].N);
+      }
+    }
+  } catch (...) {
+    for (size_t i = 0; i < jobs.size(); i++) {
+      jobs[i].done.set_exception(std::current_exception());
+    }
+    jobs.clear();
+  }
+
+  for (size_t i = 0; i < jobs.size(); i++) {
+    jobs[i].done.set_value();
+  }
+}
@@ -0,0 +1,121 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef BATCHER_H__
+#define BATCHER_H__
+
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <OpenCL/opencl.h>
+
+#include "cl_handle.h"
+
+class OpenCLEngine;
+
+struct BatcherConfig {
+    size_t  max_jobs;           // jobs per launch
+    size_t  max_elements;       // elements per launch; a larger job runs alone
+    double  max_wait_seconds;   // how long the oldest job waits for company
+
+    BatcherConfig() : max_jobs(64), max_elements(16 * 1024 * 1024), max_wait_seconds(0.0005) {}
+};
+
+struct BatcherStats {
+    size_t  batches;
+    size_t  jobs;
+    size_t  elements;
+
+    BatcherStats() : batches(0), jobs(0), elements(0) {}
+};
+
+// Coalesces many small independent adds into one launch. Jobs submitted from
+// any thread queue up until `max_jobs` or `max_elements` is reached or the
+// oldest has waited `max_wait_seconds`. A worker thread then packs their
+// inputs back to back into one staging area (recording each job's offset),
+// runs one transfer each way and one kernel launch over the packed range, and
+// scatters the results to the callers. Larger batches trade latency for
+// throughput.
+//
+// The worker drives `engine` through its own command queue; while the
+// batcher exists, other threads must not call engine.enqueue_add() or the
+// add paths, which share the engine's kernels.
+class AddBatcher {
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Job {
+        int*                c;
+        const int*          a;
+        const int*          b;
+        size_t              N;
+        Clock::time_point   submitted;
+        std::promise<void>  done;
+    };
+
+    OpenCLEngine&               m_engine;
+    BatcherConfig               m_config;
+    QueueHandle                 m_queue;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_wake;
+    std::deque<Job>             m_pending;
+    size_t                      m_pending_elements;
+    BatcherStats                m_stats;
+    bool                        m_stop;
+    std::vector<size_t>         m_offsets;      // per job in the current batch, plus the total
+    std::vector<int>            m_staging_a;
+    std::vector<int>            m_staging_b;
+    std::vector<int>            m_staging_c;
+    std::thread                 m_worker;
+
+    bool batch_full() const;
+    void worker();
+    void run_batch(std::vector<Job>& jobs);
+
+private:
+    AddBatcher(const AddBatcher&);
+    AddBatcher& operator=(const AddBatcher&);
+
+public:
+    explicit AddBatcher(OpenCLEngine& engine, const BatcherConfig& config = BatcherConfig());
+
+    // Runs the jobs still queued, then stops the worker.
+    ~AddBatcher();
+
+    // Queues c = a + b over N elements. The arrays must stay valid until the
+    // returned future is ready; it rethrows any error from the batch.
+    std::future<void> submit(int* c, const int* a, const int* b, size_t N);
+
+    BatcherStats stats();
+};
+
+#endif // BATCHER_H__
@@ -0,0 +1,674 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "benchmark.h"
+#include "cl_handle.h"
+#include "devices.h"
+#include "host_memory.h"
+#include "host_ops.h"
+#include "multi_device.h"
+#include "native_add.h"
+#include "opencl_engine.h"
+#include "thread_pool.h"
+#include "typed_add.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+cl_ulong device_ulong(cl_device_id device, cl_device_info param)
+{
+  cl_ulong value = 0;
+  check_cl(clGetDeviceInfo(device, param, sizeof(value), &value, NULL), "clGetDeviceInfo");
+  return value;
+}
+
+// Returns the operand arrays to the arena however run_benchmark() exits.
+// They come back pre-faulted and are reused by the next run, so no
+// repetition pays for first-touch page faults.
+struct HostArrays {
+    int* a;
+    int* b;
+    int* c;
+
+    HostArrays(size_t N, size_t alignment)
+    : a(NULL), b(NULL), c(NULL)
+    {
+      HostArena& arena = host_arena();
+      try {
+        a = (int*)arena.acquire(sizeof(int) * N, alignment);
+        b = (int*)arena.acquire(sizeof(int) * N, alignment);
+        c = (int*)arena.acquire(sizeof(int) * N, alignment);
+      } catch (...) {
+        arena.release(a);
+        arena.release(b);
+        throw;
+      }
+    }
+
+    ~HostArrays()
+    {
+      HostArena& arena = host_arena();
+      arena.release(c);
+      arena.release(b);
+      arena.release(a);
+    }
+};
+
+// A number for a JSON document. JSON has no NaN or infinities, which a
+// bandwidth over a zero median produces, so those are written as null.
+struct JsonNumber {
+    double value;
+};
+
+JsonNumber json_number(double value)
+{
+  JsonNumber number = { value };
+  return number;
+}
+
+std::ostream& operator<<(std::ostream& out, const JsonNumber& number)
+{
+  if (isfinite(number.value)) {
+    return out << number.value;
+  }
+  return out << "null";
+}
+
+void write_json_stats(std::ostream& out, const char* name, const SampleStats& stats)
+{
+  out << "\"" << name << "\": { "
+      << "\"min\": " << json_number(stats.min()) << ", "
+      << "\"median\": " << json_number(stats.median()) << ", "
+      << "\"p95\": " << json_number(stats.p95()) << ", "
+      << "\"p99\": " << json_number(stats.p99()) << ", "
+      << "\"mean\": " << json_number(stats.mean()) << ", "
+      << "\"stddev\": " << json_number(stats.stddev()) << " }";
+}
+
+// Escapes the characters JSON requires in a string literal.
+std::string json_string(const std::string& text)
+{
+  std::string escaped = "\"";
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '"' || text[i] == '\\') {
+      escaped += '\\';
+    }
+    if ((unsigned char)text[i] >= 0x20) {
+      escaped += text[i];
+    }
+  }
+  return escaped + "\"";
+}
+
+// Quotes a CSV field, doubling any quotes inside it.
+std::string csv_string(const std::string& text)
+{
+  std::string quoted = "\"";
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '"') {
+      quoted += '"';
+    }
+    quoted += text[i];
+  }
+  return quoted + "\"";
+}
+
+// Runs `run` config.warmup times untimed, then config.repetitions times
+// under a host timer.
+SampleStats time_runs(const BenchmarkConfig& config, const std::function<void()>& run)
+{
+  for (size_t w = 0; w < config.warmup; w++) {
+    run();
+  }
+  SampleStats seconds;
+  for (size_t r = 0; r < config.repetitions; r++) {
+    Timer timer;
+    timer.start();
+    run();
+    timer.stop();
+    seconds.add(timer.elapsed());
+  }
+  return seconds;
+}
+
+SuiteResult suite_result(const std::string& path, const std::string& type, size_t N, size_t element_size,
+                         const SampleStats& seconds)
+{
+  SuiteResult result;
+  result.path = path;
+  result.type = type;
+  result.N = N;
+  result.bytes = 3 * element_size * N;
+  result.seconds = seconds;
+  return result;
+}
+
+// The suite's operands stay below 400, so the floating types add them
+// exactly and the integer types wrap the same way on host and device.
+template <typename T> T suite_value(size_t value) { return (T)value; }
+template <> Half suite_value<Half>(size_t value) { return float_to_half((float)value); }
+
+template <typename T>
+T suite_sum(T a, T b)
+{
+  return DeviceType<T>::is_integer ? (T)((int64_t)a + (int64_t)b) : (T)(a + b);
+}
+
+template <>
+Half suite_sum<Half>(Half a, Half b)
+{
+  return float_to_half(half_to_float(a) + half_to_float(b));
+}
+
+template <typename T>
+SuiteResult time_typed(OpenCLEngine& engine, size_t N, const BenchmarkConfig& config)
+{
+  std::vector<T> a(N);
+  std::vector<T> b(N);
+  std::vector<T> c(N);
+  parallel_for(0, N, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      a[i] = suite_value<T>(i % 200);
+      b[i] = suite_value<T>((7 * i + 3) % 200);
+    }
+  });
+
+  SampleStats seconds = time_runs(config, [&]() { add_opencl<T>(engine, &c[0], &a[0], &b[0], N); });
+
+  // There is no checksum for the non-int types, so sampled validation only
+  // checks the sampled elements.
+  if (config.validation.mode == VALIDATE_FULL) {
+    parallel_for(0, N, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        T expected = suite_sum(a[i], b[i]);
+        if (memcmp(&expected, &c[i], sizeof(T)) != 0) {
+          throw std::runtime_error("Result validation failed");
+        }
+      }
+    });
+  } else if (config.validation.mode == VALIDATE_SAMPLED) {
+    std::vector<size_t> indices = sample_indices(N, config.validation.samples);
+    for (size_t s = 0; s < indices.size(); s++) {
+      size_t i = indices[s];
+      T expected = suite_sum(a[i], b[i]);
+      if (memcmp(&expected, &c[i], sizeof(T)) != 0) {
+        throw std::runtime_error("Result validation failed: sampled element mismatch");
+      }
+    }
+  }
+  return suite_result("typed", DeviceType<T>::name(), N, sizeof(T), seconds);
+}
+
+SuiteResult time_typed(OpenCLEngine& engine, const std::string& type, size_t N, const BenchmarkConfig& config)
+{
+  if (type == "char") return time_typed<cl_char>(engine, N, config);
+  if (type == "uchar") return time_typed<cl_uchar>(engine, N, config);
+  if (type == "short") return time_typed<cl_short>(engine, N, config);
+  if (type == "ushort") return time_typed<cl_ushort>(engine, N, config);
+  if (type == "int") return time_typed<cl_int>(engine, N, config);
+  if (type == "uint") return time_typed<cl_uint>(engine, N, config);
+  if (type == "long") return time_typed<cl_long>(engine, N, config);
+  if (type == "ulong") return time_typed<cl_ulong>(engine, N, config);
+  if (type == "float") return time_typed<cl_float>(engine, N, config);
+  if (type == "double") return time_typed<cl_double>(engine, N, config);
+  if (type == "half") return time_typed<Half>(engine, N, config);
+  throw std::invalid_argument("run_suite: unknown element type " + type);
+}
+
+void check_suite_config(const BenchmarkConfig& config, const char* function)
+{
+  if (config.sizes.empty() || config.repetitions == 0 ||
+      std::find(config.sizes.begin(), config.sizes.end(), (size_t)0) != config.sizes.end()) {
+    throw std::invalid_argument(std::string(function) + ": needs non-zero sizes and at least one repetition");
+  }
+}
+
+} // namespace
+
+std::vector<size_t> benchmark_sweep_sizes(const OpenCLEngine& engine)
+{
+  cl_ulong global_mem = device_ulong(engine.device(), CL_DEVICE_GLOBAL_MEM_SIZE);
+  cl_ulong max_alloc = device_ulong(engine.device(), CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+
+  std::vector<size_t> sizes;
+  for (cl_ulong bytes = 4096; bytes <= (1ULL << 30); bytes *= 4) {
+    if (bytes > max_alloc || 3 * bytes > global_mem) {
+      break;
+    }
+    sizes.push_back(bytes / sizeof(int));
+  }
+  return sizes;
+}
+
+double measure_copy_bandwidth(OpenCLEngine& engine, size_t bytes)
+{
+  BufferPool& pool = engine.pool();
+  PooledBuffer source(pool, bytes, CL_MEM_READ_WRITE);
+  PooledBuffer destination(pool, bytes, CL_MEM_READ_WRITE);
+  QueueFinish finish(engine.queue());
+
+  // Best of a few copies; the first also faults the buffers in.
+  double best = 0.0;
+  for (size_t i = 0; i < 4; i++) {
+    EventHandle copy;
+    check_cl(clEnqueueCopyBuffer(engine.queue(), source.get(), destination.get(), 0, 0, bytes, 0, NULL, copy.out()),
+             "clEnqueueCopyBuffer");
+    cl_event event = copy.get();
+    check_cl(clWaitForEvents(1, &event), "clWaitForEvents");
+    double seconds = stage_timing(event).run_seconds();
+    if (seconds > 0.0) {
+      best = std::max(best, 2.0 * bytes / seconds * 1e-9);
+    }
+  }
+  return best;
+}
+
+BenchmarkReport run_benchmark(OpenCLEngine& engine, const BenchmarkConfig& config)
+{
+  if (config.sizes.empty() || config.repetitions == 0) {
+    throw std::invalid_argument("run_benchmark: needs at least one size and one repetition");
+  }
+
+  BenchmarkReport report;
+  report.device = device_name(engine.device());
+  report.kernel = add_kernel_name(engine.add_kernel());
+
+  size_t max_N = *std::max_element(config.sizes.begin(), config.sizes.end());
+  report.peak_gbps = config.peak_gbps > 0.0 ? config.peak_gbps
+                                            : measure_copy_bandwidth(engine, std::max(sizeof(int) * max_N, (size_t)1 << 20));
+
+  HostArrays arrays(max_N, engine.host_alignment());
+  for (size_t s = 0; s < config.sizes.size(); s++) {
+    size_t N = config.sizes[s];
+    uint64_t checksum = fill_operands(arrays.a, arrays.b, 0, N);
+
+    for (size_t w = 0; w < config.warmup; w++) {
+      engine.add(arrays.c, arrays.a, arrays.b, N);
+    }
+
+    BenchmarkResult result;
+    result.N = N;
+    result.bytes = 3 * sizeof(int) * N;
+    for (size_t r = 0; r < config.repetitions; r++) {
+      Timer timer;
+      timer.start();
+      double kernel_seconds = engine.add(arrays.c, arrays.a, arrays.b, N);
+      timer.stop();
+      result.kernel.add(kernel_seconds);
+      result.total.add(timer.elapsed());
+    }
+
+    // Every repetition computes the same result, so checking the last one
+    // is enough, and keeps validation out of the timings.
+    validate_add(arrays.c, arrays.a, arrays.b, N, checksum, config.validation);
+    report.results.push_back(result);
+  }
+  return report;
+}
+
+void write_benchmark(std::ostream& out, const BenchmarkReport& report, BenchmarkFormat format)
+{
+  if (format == FORMAT_CSV) {
+    out << "device,kernel,N,bytes,kernel_min_s,kernel_median_s,kernel_p95_s,kernel_p99_s,kernel_mean_s,kernel_stddev_s,"
+        << "total_median_s,kernel_gbps,total_gbps,elements_per_s,peak_gbps\n";
+    for (size_t i = 0; i < report.results.size(); i++) {
+      const BenchmarkResult& r = report.results[i];
+      out << csv_string(report.device) << "," << report.kernel << "," << r.N << "," << r.bytes << ","
+          << r.kernel.min() << "," << r.kernel.median() << "," << r.kernel.p95() << "," << r.kernel.p99() << ","
+          << r.kernel.mean() << "," << r.kernel.stddev() << "," << r.total.median() << ","
+          << r.kernel_gbps() << "," << r.total_gbps() << "," << r.elements_per_second() << ","
+          << report.peak_gbps << "\n";
+    }
+  } else if (format == FORMAT_JSON) {
+    out << "{\n"
+        << "  \"device\": " << json_string(report.device) << ",\n"
+        << "  \"kernel\": " << json_string(report.kernel) << ",\n"
+        << "  \"peak_gbps\": " << json_number(report.peak_gbps) << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < report.results.size(); i++) {
+      const BenchmarkResult& r = report.results[i];
+      out << "    { \"N\": " << r.N << ", \"bytes\": " << r.bytes << ", ";
+      write_json_stats(out, "kernel_s", r.kernel);
+      out << ", ";
+      write_json_stats(out, "total_s", r.total);
+      out << ", \"kernel_gbps\": " << json_number(r.kernel_gbps())
+          << ", \"total_gbps\": " << json_number(r.total_gbps())
+          << ", \"elements_per_s\": " << json_number(r.elements_per_second()) << " }"
+          << (i + 1 < report.results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n"
+        << "}\n";
+  } else {
+    out << report.device << ", kernel " << report.kernel
+        << ", reference bandwidth " << report.peak_gbps << " GB/s\n";
+    for (size_t i = 0; i < report.results.size(); i++) {
+      const BenchmarkResult& r = report.results[i];
+      out << "N = " << r.N << ": kernel median " << r.kernel.median() * 1e3 << "ms"
+          << " (min " << r.kernel.min() * 1e3 << ", p95 " << r.kernel.p95() * 1e3
+          << ", p99 " << r.kernel.p99() * 1e3 << ", stddev " << r.kernel.stddev() * 1e3 << ")"
+          << ", " << r.kernel_gbps() << " GB/s";
+      if (report.peak_gbps > 0.0) {
+        out << " (" << 100.0 * r.kernel_gbps() / report.peak_gbps << "% of reference)";
+      }
+      out << ", " << r.elements_per_second() << " elements/s"
+          << ", end-to-end " << r.total_gbps() << " GB/s\n";
+    }
+  }
+  out.flush();
+}
+
+std::vector<NativeComparison> compare_native(OpenCLEngine& engine, const BenchmarkConfig& config)
+{
+  if (config.sizes.empty() || config.repetitions == 0) {
+    throw std::invalid_argument("compare_native: needs at least one size and one repetition");
+  }
+
+  size_t max_N = *std::max_element(config.sizes.begin(), config.sizes.end());
+  HostArrays arrays(max_N, engine.host_alignment());
+
+  std::vector<NativeComparison> comparisons;
+  for (size_t s = 0; s < config.sizes.size(); s++) {
+    size_t N = config.sizes[s];
+    uint64_t checksum = fill_operands(arrays.a, arrays.b, 0, N);
+
+    for (size_t w = 0; w < config.warmup; w++) {
+      native_add(arrays.c, arrays.a, arrays.b, N);
+      engine.add(arrays.c, arrays.a, arrays.b, N);
+    }
+
+    SampleStats native;
+    SampleStats opencl;
+    for (size_t r = 0; r < config.repetitions; r++) {
+      Timer timer;
+      timer.start();
+      native_add(arrays.c, arrays.a, arrays.b, N);
+      timer.stop();
+      native.add(timer.elapsed());
+      if (r == 0) {
+        validate_add(arrays.c, arrays.a, arrays.b, N, checksum, config.validation);
+      }
+
+      timer.reset();
+      timer.start();
+      engine.add(arrays.c, arrays.a, arrays.b, N);
+      timer.stop();
+      opencl.add(timer.elapsed());
+    }
+    validate_add(arrays.c, arrays.a, arrays.b, N, checksum, config.validation);
+
+    NativeComparison comparison;
+    comparison.N = N;
+    comparison.native_seconds = native.median();
+    comparison.opencl_seconds = opencl.median();
+    comparisons.push_back(comparison);
+  }
+  return comparisons;
+}
+
+size_t crossover_size(const std::vector<NativeComparison>& comparisons)
+{
+  std::vector<NativeComparison> sorted(comparisons);
+  std::sort(sorted.begin(), sorted.end(), [](const NativeComparison& x, const NativeComparison& y) {
+    return x.N < y.N;
+  });
+
+  // Walk down from the largest size while OpenCL keeps winning.
+  size_t crossover = 0;
+  for (size_t i = sorted.size(); i-- > 0;) {
+    if (sorted[i].opencl_seconds >= sorted[i].native_seconds) {
+      break;
+    }
+    crossover = sorted[i].N;
+  }
+  return crossover;
+}
+
+void write_comparison(std::ostream& out, const std::string& device,
+                      const std::vector<NativeComparison>& comparisons, BenchmarkFormat format)
+{
+  size_t crossover = crossover_size(comparisons);
+  if (format == FORMAT_CSV) {
+    out << "device,native_isa,N,native_s,opencl_s,speedup\n";
+    for (size_t i = 0; i < comparisons.size(); i++) {
+      const NativeComparison& c = comparisons[i];
+      out << csv_string(device) << "," << native_add_isa() << "," << c.N << ","
+          << c.native_seconds << "," << c.opencl_seconds << "," << c.native_seconds / c.opencl_seconds << "\n";
+    }
+  } else if (format == FORMAT_JSON) {
+    out << "{\n"
+        << "  \"device\": " << json_string(device) << ",\n"
+        << "  \"native_isa\": " << json_string(native_add_isa()) << ",\n"
+        << "  \"crossover_N\": " << crossover << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < comparisons.size(); i++) {
+      const NativeComparison& c = comparisons[i];
+      out << "    { \"N\": " << c.N << ", \"native_s\": " << json_number(c.native_seconds)
+          << ", \"opencl_s\": " << json_number(c.opencl_seconds) << " }"
+          << (i + 1 < comparisons.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n"
+        << "}\n";
+  } else {
+    out << device << " vs native " << native_add_isa() << " on "
+        << host_thread_pool().size() << " threads (OpenCL times include transfers)\n";
+    for (size_t i = 0; i < comparisons.size(); i++) {
+      const NativeComparison& c = comparisons[i];
+      out << "N = " << c.N << ": native " << c.native_seconds * 1e3 << "ms, OpenCL "
+          << c.opencl_seconds * 1e3 << "ms, "
+          << (c.opencl_seconds < c.native_seconds ? "OpenCL" : "native") << " wins\n";
+    }
+    if (crossover) {
+      out << "Crossover: OpenCL wins from N = " << crossover << "\n";
+    } else {
+      out << "Crossover: none, native wins at the largest size\n";
+    }
+  }
+  out.flush();
+}
+
+std::vector<QueueModeResult> compare_queue_modes(OpenCLEngine& engine, size_t N, const StreamConfig& stream,
+                                                 const BenchmarkConfig& config)
+{
+  if (config.repetitions == 0) {
+    throw std::invalid_argument("compare_queue_modes: needs at least one repetition");
+  }
+
+  HostArrays arrays(N, engine.host_alignment());
+  uint64_t checksum = fill_operands(arrays.a, arrays.b, 0, N);
+
+  bool out_of_order = supports_out_of_order(engine.device());
+  size_t queue_counts[2] = { 1, std::max(stream.queues, (size_t)2) };
+  std::vector<QueueModeResult> results;
+  for (size_t q = 0; q < 2; q++) {
+    for (size_t o = 0; o < (out_of_order ? 2 : 1); o++) {
+      StreamConfig mode = stream;
+      mode.queues = queue_counts[q];
+      mode.out_of_order = o == 1;
+
+      QueueModeResult result;
+      result.queues = mode.queues;
+      result.out_of_order = mode.out_of_order;
+      result.bytes = 3 * sizeof(int) * N;
+      for (size_t w = 0; w < config.warmup; w++) {
+        stream_add(engine, arrays.c, arrays.a, arrays.b, N, mode);
+      }
+      for (size_t r = 0; r < config.repetitions; r++) {
+        result.seconds.add(stream_add(engine, arrays.c, arrays.a, arrays.b, N, mode).seconds);
+      }
+      validate_add(arrays.c, arrays.a, arrays.b, N, checksum, config.validation);
+      results.push_back(result);
+    }
+  }
+  return results;
+}
+
+void write_queue_modes(std::ostream& out, const std::string& device,
+                       const std::vector<QueueModeResult>& results, BenchmarkFormat format)
+{
+  if (format == FORMAT_CSV) {
+    out << "device,queues,out_of_order,bytes,median_s,min_s,max_s,gbps\n";
+    for (size_t i = 0; i < results.size(); i++) {
+      const QueueModeResult& r = results[i];
+      out << csv_string(device) << "," << r.queues << "," << (r.out_of_order ? 1 : 0) << "," << r.bytes << ","
+          << r.seconds.median() << "," << r.seconds.min() << "," << r.seconds.max() << "," << r.gbps() << "\n";
+    }
+  } else if (format == FORMAT_JSON) {
+    out << "{\n"
+        << "  \"device\": " << json_string(device) << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+      const QueueModeResult& r = results[i];
+      out << "    { \"queues\": " << r.queues << ", \"out_of_order\": " << (r.out_of_order ? "true" : "false")
+          << ", \"bytes\": " << r.bytes << ", ";
+      write_json_stats(out, "seconds", r.seconds);
+      out << ", \"gbps\": " << json_number(r.gbps()) << " }"
+          << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n"
+        << "}\n";
+  } else {
+    out << device << ": streaming by queue mode (median of " << (results.empty() ? 0 : results[0].seconds.count())
+        << " runs)\n";
+    size_t fastest = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+      const QueueModeResult& r = results[i];
+      out << r.queues << (r.queues == 1 ? " queue, " : " queues, ") << (r.out_of_order ? "out of order" : "in order")
+          << ": " << r.seconds.median() * 1e3 << "ms, " << r.gbps() << " GB/s\n";
+      if (r.seconds.median() < results[fastest].seconds.median()) {
+        fastest = i;
+      }
+    }
+    if (results.size() == 2) {
+      out << "Out-of-order queues are not supported on this device\n";
+    }
+    if (!results.empty()) {
+      out << "Fastest: " << results[fastest].queues << (results[fastest].queues == 1 ? " queue, " : " queues, ")
+          << (results[fastest].out_of_order ? "out of order" : "in order") << "\n";
+    }
+  }
+  out.flush();
+}
+
+std::string SuiteResult::name() const
+{
+  std::ostringstream name;
+  name << path << "/" << type << "/" << N;
+  return name.str();
+}
+
+std::vector<std::string> suite_types()
+{
+  const char* names[] = { "char", "short", "int", "long", "float", "double", "half" };
+  return std::vector<std::string>(names, names + sizeof(names) / sizeof(names[0]));
+}
+
+std::vector<SuiteResult> run_suite(OpenCLEngine& engine, const BenchmarkConfig& config,
+                                   const std::vector<std::string>& types)
+{
+  check_suite_config(config, "run_suite");
+  bool fp64 = engine.supports_fp64();
+
+  // zero_copy and stream run the kernel the engine was configured with.
+  AddKernel kernel = engine.add_kernel();
+  size_t local_size = engine.local_size();
+  auto restore = [&]() {
+    engine.set_add_kernel(kernel);
+    engine.set_local_size(local_size);
+  };
+
+  size_t max_N = *std::max_element(config.sizes.begin(), config.sizes.end());
+  HostArrays arrays(max_N, engine.host_alignment());
+  std::vector<SuiteResult> results;
+  try {
+    for (size_t s = 0; s < config.sizes.size(); s++) {
+      size_t N = config.sizes[s];
+      uint64_t checksum = fill_operands(arrays.a, arrays.b, 0, N);
+
+      // c is cleared before each path so that one which writes nothing
+      // can't pass on the previous path's results.
+      for (size_t k = 0; k < ADD_KERNEL_COUNT; k++) {
+        engine.set_add_kernel((AddKernel)k);
+        memset(arrays.c, 0, sizeof(int) * N);
+        SampleStats seconds = time_runs(config, [&]() { engine.add(arrays.c, arrays.a, arrays.b, N); });
+        validate_add(arrays.c, arrays.a, arrays.b, N, checksum, config.validation);
+        results.push_back(suite_result(add_kernel_name((AddKernel)k), "int", N, sizeof(int), seconds));
+      }
+      restore();
+
+      memset(arrays.c, 0, sizeof(int) * N);
+      SampleStats seconds = time_runs(config, [&]() { engine.add_zero_copy(arrays.c, arrays.a, arrays.b, N); });
+      validate_add(arrays.c, arrays.a, arrays.b, N, checksum, config.validation);
+      results.push_back(suite_result("zero_copy", "int", N, sizeof(int), seconds));
+
+      // Eight chunks, so that transfers and kernels have something to
+      // overlap at every size.
+      StreamConfig stream;
+      stream.chunk_elements = std::max(N / 8, (size_t)1);
+      memset(arrays.c, 0, sizeof(int) * N);
+      seconds = time_runs(config, [&]() { stream_add(engine, arrays.c, arrays.a, arrays.b, N, stream); });
+      validate_add(arrays.c, arrays.a, arrays.b, N, checksum, config.validation);
+      results.push_back(suite_result("stream", "int", N, sizeof(int), seconds));
+
+      for (size_t t = 0; t < types.size(); t++) {
+        if (types[t] == "double" && !fp64) {
+          continue;
+        }
+        results.push_back(time_typed(engine, types[t], N, config));
+      }
+    }
+  } catch (...) {
+    restore();
+    throw;
+  }
+  restore();
+  return results;
+}
+
+std::vector<SuiteResult> run_multi_device_suite(MultiDeviceAdd& multi, const BenchmarkConfig& config)
+{
+  check_suite_config(config, "run_multi_device_suite");
+
+  size_t max_N = *std::max_element(config.sizes.begin(), config.sizes.end());
+  HostArrays arrays(max_N, multi.engine(0).host_alignment());
+  std::vector<SuiteResult> results;
+  for (size_t s = 0; s < config.sizes.size(); s++) {
+    size_t N = config.sizes[s];
+    uint64_t checksum = fill_operands(arrays.a, arrays.b, 0, N);
+    memset(arrays.c, 0, sizeof(int) * N);
+    SampleStats seconds = time_runs(config, [&]() { multi.add(arrays.c, arrays.a, arrays.b, N); });
+    validate_add(arrays.c, arrays.a, arrays.b, N, checksum, config.validation);
+    results.push_back(suite_result("multi_device", "int", N, sizeof(int), seconds));
+  }
+  return results;
+}
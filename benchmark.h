@@ -0,0 +1,164 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef BENCHMARK_H__
+#define BENCHMARK_H__
+
+#include <stddef.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "host_ops.h"
+#include "stream_add.h"
+#include "timer.h"
+
+class MultiDeviceAdd;
+class OpenCLEngine;
+
+enum BenchmarkFormat {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+};
+
+struct BenchmarkConfig {
+    size_t              warmup;             // untimed runs per size
+    size_t              repetitions;        // timed runs per size
+    std::vector<size_t> sizes;              // element counts to run
+    ValidationOptions   validation;         // applied to the last repetition
+    double              peak_gbps;          // reference bandwidth; 0 = measure
+
+    BenchmarkConfig() : warmup(2), repetitions(10), peak_gbps(0.0) {}
+};
+
+struct BenchmarkResult {
+    size_t      N;
+    size_t      bytes;          // a + b + c
+    SampleStats kernel;         // device time of the kernel, seconds
+    SampleStats total;          // host time of the whole add, transfers included
+
+    double kernel_gbps() const { return bytes / kernel.median() * 1e-9; }
+    double total_gbps() const { return bytes / total.median() * 1e-9; }
+    double elements_per_second() const { return N / kernel.median(); }
+};
+
+struct BenchmarkReport {
+    std::string                     device;
+    std::string                     kernel;
+    double                          peak_gbps;
+    std::vector<BenchmarkResult>    results;
+};
+
+// Element counts from 4 KiB to 1 GiB per array in steps of 4x, limited to
+// what fits the engine's device (three arrays, max allocation size).
+std::vector<size_t> benchmark_sweep_sizes(const OpenCLEngine& engine);
+
+// Device-to-device clEnqueueCopyBuffer bandwidth, counting bytes read plus
+// bytes written. OpenCL has no query for theoretical memory bandwidth, so
+// this stands in as the reference the add kernel is compared against.
+double measure_copy_bandwidth(OpenCLEngine& engine, size_t bytes);
+
+// Runs config.warmup untimed and config.repetitions timed adds at each size.
+// Operands live in one set of aligned host arrays sized for the largest N.
+BenchmarkReport run_benchmark(OpenCLEngine& engine, const BenchmarkConfig& config);
+
+void write_benchmark(std::ostream& out, const BenchmarkReport& report, BenchmarkFormat format);
+
+// Median host times of native_add() and of OpenCLEngine::add() at one size.
+// The OpenCL time is end to end, transfers included, since that is what a
+// caller choosing between the two would pay.
+struct NativeComparison {
+    size_t  N;
+    double  native_seconds;
+    double  opencl_seconds;
+};
+
+// Times both implementations at every size in config.sizes, with the same
+// warmup, repetitions and validation as run_benchmark().
+std::vector<NativeComparison> compare_native(OpenCLEngine& engine, const BenchmarkConfig& config);
+
+// The smallest measured N from which OpenCL is faster at that and every
+// larger measured size, or 0 if the native path wins at the largest size.
+size_t crossover_size(const std::vector<NativeComparison>& comparisons);
+
+void write_comparison(std::ostream& out, const std::string& device,
+                      const std::vector<NativeComparison>& comparisons, BenchmarkFormat format);
+
+// stream_add() timed with one arrangement of command queues.
+struct QueueModeResult {
+    size_t      queues;
+    bool        out_of_order;
+    size_t      bytes;          // a + b + c
+    SampleStats seconds;        // host time of the whole stream
+
+    double gbps() const { return bytes / seconds.median() * 1e-9; }
+};
+
+// Streams N elements with the chunking of `stream` on one in-order queue,
+// one out-of-order queue, several in-order queues and several out-of-order
+// queues (stream.queues, at least 2), with the warmup, repetitions and
+// validation of `config`. The out-of-order modes are left out on devices
+// that don't support them.
+std::vector<QueueModeResult> compare_queue_modes(OpenCLEngine& engine, size_t N, const StreamConfig& stream,
+                                                 const BenchmarkConfig& config);
+
+void write_queue_modes(std::ostream& out, const std::string& device,
+                       const std::vector<QueueModeResult>& results, BenchmarkFormat format);
+
+// One case of the regression suite: an add path at one element type and
+// size, timed on the host from the call until the result is in host memory.
+struct SuiteResult {
+    std::string path;           // add kernel name, "zero_copy", "stream", "typed" or "multi_device"
+    std::string type;           // element type, e.g. "int" or "half"
+    size_t      N;
+    size_t      bytes;          // a + b + c
+    SampleStats seconds;
+
+    // "<path>/<type>/<N>", the key results are stored and compared under.
+    std::string name() const;
+    double gbps() const { return bytes / seconds.median() * 1e-9; }
+};
+
+// The element types run_suite() times through add_typed, in the order it
+// runs them: char, short, int, long, float, double and half.
+std::vector<std::string> suite_types();
+
+// Runs every single-device add path at each size in config.sizes: the
+// scalar, vectorized and coarsened int kernels through add(), the
+// preferred kernel through add_zero_copy() and stream_add(), and the
+// typed kernel for each of `types` (see suite_types()). Double is left
+// out unless OpenCLEngine::supports_fp64(). The engine's kernel selection
+// is restored afterwards.
+std::vector<SuiteResult> run_suite(OpenCLEngine& engine, const BenchmarkConfig& config,
+                                   const std::vector<std::string>& types);
+
+// The "multi_device" path: `multi`, already calibrated, at each size in
+// config.sizes.
+std::vector<SuiteResult> run_multi_device_suite(MultiDeviceAdd& multi, const BenchmarkConfig& config);
+
+#endif // BENCHMARK_H__
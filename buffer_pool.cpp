@@ -0,0 +1,157 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "buffer_pool.h"
+#include "cl_handle.h"
+#include "trace.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdexcept>
+
+// Smallest size class handed out, so tiny requests share buffers too.
+static const size_t kMinSizeClass = 4096;
+
+BufferPool::BufferPool(cl_context context)
+: m_context(context)
+, m_max_alloc_size(SIZE_MAX)
+{
+  // Rounding must not take a request past what every device in the context
+  // can allocate in one buffer.
+  size_t size = 0;
+  if (clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &size) == CL_SUCCESS && size > 0) {
+    std::vector<cl_device_id> devices(size / sizeof(cl_device_id));
+    if (clGetContextInfo(context, CL_CONTEXT_DEVICES, size, &devices[0], NULL) == CL_SUCCESS) {
+      for (size_t i = 0; i < devices.size(); i++) {
+        cl_ulong max_alloc = 0;
+        if (clGetDeviceInfo(devices[i], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL) == CL_SUCCESS &&
+            max_alloc > 0 && max_alloc < m_max_alloc_size) {
+          m_max_alloc_size = (size_t)max_alloc;
+        }
+      }
+    }
+  }
+}
+
+BufferPool::~BufferPool()
+{
+  trim();
+  for (std::map<cl_mem, Key>::iterator it = m_in_use.begin(); it != m_in_use.end(); ++it) {
+    clReleaseMemObject(it->first);
+  }
+}
+
+size_t BufferPool::size_class(size_t bytes, size_t max_bytes)
+{
+  size_t size = kMinSizeClass;
+  while (size < bytes && size <= max_bytes / 2) {
+    size <<= 1;
+  }
+  // Past the largest class that fits, requests get a buffer of their exact
+  // size rather than one the device would refuse.
+  return size < bytes || size > max_bytes ? bytes : size;
+}
+
+cl_mem BufferPool::acquire(size_t bytes, cl_mem_flags flags)
+{
+  Key key(flags, size_class(bytes, m_max_alloc_size));
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  std::map<Key, std::vector<cl_mem> >::iterator free_list = m_free.find(key);
+  if (free_list != m_free.end() && !free_list->second.empty()) {
+    cl_mem buffer = free_list->second.back();
+    free_list->second.pop_back();
+    m_in_use[buffer] = key;
+    m_stats.hits++;
+    return buffer;
+  }
+
+  // Don't hold up hits on other threads while the driver allocates.
+  lock.unlock();
+  cl_int err = CL_SUCCESS;
+  cl_mem buffer = NULL;
+  {
+    TraceScope scope("clCreateBuffer", "alloc");
+    buffer = clCreateBuffer(m_context, flags, key.second, NULL, &err);
+  }
+  lock.lock();
+  if (!buffer || err != CL_SUCCESS) {
+    // Give back idle buffers and try once more before failing.
+    trim_locked();
+    buffer = clCreateBuffer(m_context, flags, key.second, NULL, &err);
+    if (!buffer || err != CL_SUCCESS) {
+      throw OpenCLError("clCreateBuffer", err);
+    }
+  }
+
+  m_in_use[buffer] = key;
+  m_stats.misses++;
+  m_stats.bytes_resident += key.second;
+  if (m_stats.bytes_resident > m_stats.high_water) {
+    m_stats.high_water = m_stats.bytes_resident;
+  }
+  return buffer;
+}
+
+void BufferPool::release(cl_mem buffer)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::map<cl_mem, Key>::iterator it = m_in_use.find(buffer);
+  // ~PooledBuffer calls this, possibly while unwinding, so it must not
+  // throw. A buffer the pool never handed out is a caller bug; outside
+  // debug builds it is released rather than pooled.
+  assert(it != m_in_use.end() && "BufferPool::release: buffer not from this pool");
+  if (it == m_in_use.end()) {
+    clReleaseMemObject(buffer);
+    return;
+  }
+  m_free[it->second].push_back(buffer);
+  m_in_use.erase(it);
+}
+
+void BufferPool::trim()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  trim_locked();
+}
+
+BufferPoolStats BufferPool::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void BufferPool::trim_locked()
+{
+  for (std::map<Key, std::vector<cl_mem> >::iterator it = m_free.begin(); it != m_free.end(); ++it) {
+    for (size_t i = 0; i < it->second.size(); i++) {
+      clReleaseMemObject(it->second[i]);
+      m_stats.bytes_resident -= it->first.second;
+    }
+  }
+  m_free.clear();
+}
@@ -0,0 +1,132 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef BUFFER_POOL_H__
+#define BUFFER_POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <OpenCL/opencl.h>
+
+struct BufferPoolStats {
+    size_t  hits;           // acquire() served from a free buffer
+    size_t  misses;         // acquire() that had to call clCreateBuffer
+    size_t  bytes_resident; // bytes of all buffers owned by the pool
+    size_t  high_water;     // largest bytes_resident seen so far
+
+    BufferPoolStats() : hits(0), misses(0), bytes_resident(0), high_water(0) {}
+};
+
+// Recycles cl_mem objects within one context. Requests are rounded up to a
+// power-of-two size class, capped at the devices' maximum allocation, so
+// repeated calls with similar sizes reuse the same buffers instead of
+// paying for clCreateBuffer/clReleaseMemObject.
+// Safe to use from several threads.
+class BufferPool {
+protected:
+    typedef std::pair<cl_mem_flags, size_t> Key;
+
+    cl_context                          m_context;
+    size_t                              m_max_alloc_size;   // smallest CL_DEVICE_MAX_MEM_ALLOC_SIZE in the context
+    std::map<Key, std::vector<cl_mem> > m_free;
+    std::map<cl_mem, Key>               m_in_use;
+    BufferPoolStats                     m_stats;
+    mutable std::mutex                  m_mutex;
+
+    void trim_locked();
+
+private:
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+public:
+    explicit BufferPool(cl_context context);
+    ~BufferPool();
+
+    // The power of two at or above `bytes`, or `bytes` itself if that class
+    // would exceed `max_bytes`.
+    static size_t size_class(size_t bytes, size_t max_bytes = SIZE_MAX);
+
+    // Returns a buffer of at least `bytes` bytes created with `flags`.
+    cl_mem acquire(size_t bytes, cl_mem_flags flags);
+
+    // Returns a buffer obtained from acquire() to the pool. Never throws;
+    // a buffer from elsewhere is asserted on and released outright.
+    void release(cl_mem buffer);
+
+    // Releases every buffer that is not currently checked out.
+    void trim();
+
+    BufferPoolStats stats() const;
+};
+
+// A buffer checked out of a BufferPool and returned to it on destruction,
+// so that the error paths of a function need no cleanup code. The device
+// must be done with the buffer by then: on failure, finish the queue
+// before the handle goes out of scope. Move-only.
+class PooledBuffer {
+protected:
+    BufferPool* m_pool;
+    cl_mem      m_buffer;
+
+public:
+    PooledBuffer() : m_pool(NULL), m_buffer(NULL) {}
+    PooledBuffer(BufferPool& pool, size_t bytes, cl_mem_flags flags)
+    : m_pool(&pool), m_buffer(pool.acquire(bytes, flags)) {}
+    PooledBuffer(PooledBuffer&& other) : m_pool(other.m_pool), m_buffer(other.m_buffer) { other.m_buffer = NULL; }
+    ~PooledBuffer() { reset(); }   // BufferPool::release() never throws
+
+    PooledBuffer& operator=(PooledBuffer&& other)
+    {
+      if (this != &other) {
+        reset();
+        m_pool = other.m_pool;
+        m_buffer = other.m_buffer;
+        other.m_buffer = NULL;
+      }
+      return *this;
+    }
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    cl_mem get() const { return m_buffer; }
+
+    void reset()
+    {
+      if (m_buffer) {
+        m_pool->release(m_buffer);
+        m_buffer = NULL;
+      }
+    }
+};
+
+#endif // BUFFER_POOL_H__
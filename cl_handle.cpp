@@ -0,0 +1,141 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "cl_handle.h"
+
+#include <string.h>
+#include <vector>
+
+namespace {
+
+struct ErrorName {
+    cl_int      code;
+    const char* name;
+};
+
+// OpenCL 1.2 error codes. Listed by value rather than through the CL_*
+// macros so that the table compiles against older headers too.
+const ErrorName kErrorNames[] = {
+  { 0, "CL_SUCCESS" },
+  { -1, "CL_DEVICE_NOT_FOUND" },
+  { -2, "CL_DEVICE_NOT_AVAILABLE" },
+  { -3, "CL_COMPILER_NOT_AVAILABLE" },
+  { -4, "CL_MEM_OBJECT_ALLOCATION_FAILURE" },
+  { -5, "CL_OUT_OF_RESOURCES" },
+  { -6, "CL_OUT_OF_HOST_MEMORY" },
+  { -7, "CL_PROFILING_INFO_NOT_AVAILABLE" },
+  { -8, "CL_MEM_COPY_OVERLAP" },
+  { -9, "CL_IMAGE_FORMAT_MISMATCH" },
+  { -10, "CL_IMAGE_FORMAT_NOT_SUPPORTED" },
+  { -11, "CL_BUILD_PROGRAM_FAILURE" },
+  { -12, "CL_MAP_FAILURE" },
+  { -13, "CL_MISALIGNED_SUB_BUFFER_OFFSET" },
+  { -14, "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST" },
+  { -15, "CL_COMPILE_PROGRAM_FAILURE" },
+  { -16, "CL_LINKER_NOT_AVAILABLE" },
+  { -17, "CL_LINK_PROGRAM_FAILURE" },
+  { -18, "CL_DEVICE_PARTITION_FAILED" },
+  { -19, "CL_KERNEL_ARG_INFO_NOT_AVAILABLE" },
+  { -30, "CL_INVALID_VALUE" },
+  { -31, "CL_INVALID_DEVICE_TYPE" },
+  { -32, "CL_INVALID_PLATFORM" },
+  { -33, "CL_INVALID_DEVICE" },
+  { -34, "CL_INVALID_CONTEXT" },
+  { -35, "CL_INVALID_QUEUE_PROPERTIES" },
+  { -36, "CL_INVALID_COMMAND_QUEUE" },
+  { -37, "CL_INVALID_HOST_PTR" },
+  { -38, "CL_INVALID_MEM_OBJECT" },
+  { -39, "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR" },
+  { -40, "CL_INVALID_IMAGE_SIZE" },
+  { -41, "CL_INVALID_SAMPLER" },
+  { -42, "CL_INVALID_BINARY" },
+  { -43, "CL_INVALID_BUILD_OPTIONS" },
+  { -44, "CL_INVALID_PROGRAM" },
+  { -45, "CL_INVALID_PROGRAM_EXECUTABLE" },
+  { -46, "CL_INVALID_KERNEL_NAME" },
+  { -47, "CL_INVALID_KERNEL_DEFINITION" },
+  { -48, "CL_INVALID_KERNEL" },
+  { -49, "CL_INVALID_ARG_INDEX" },
+  { -50, "CL_INVALID_ARG_VALUE" },
+  { -51, "CL_INVALID_ARG_SIZE" },
+  { -52, "CL_INVALID_KERNEL_ARGS" },
+  { -53, "CL_INVALID_WORK_DIMENSION" },
+  { -54, "CL_INVALID_WORK_GROUP_SIZE" },
+  { -55, "CL_INVALID_WORK_ITEM_SIZE" },
+  { -56, "CL_INVALID_GLOBAL_OFFSET" },
+  { -57, "CL_INVALID_EVENT_WAIT_LIST" },
+  { -58, "CL_INVALID_EVENT" },
+  { -59, "CL_INVALID_OPERATION" },
+  { -60, "CL_INVALID_GL_OBJECT" },
+  { -61, "CL_INVALID_BUFFER_SIZE" },
+  { -62, "CL_INVALID_MIP_LEVEL" },
+  { -63, "CL_INVALID_GLOBAL_WORK_SIZE" },
+  { -64, "CL_INVALID_PROPERTY" },
+  { -65, "CL_INVALID_IMAGE_DESCRIPTOR" },
+  { -66, "CL_INVALID_COMPILER_OPTIONS" },
+  { -67, "CL_INVALID_LINKER_OPTIONS" },
+  { -68, "CL_INVALID_DEVICE_PARTITION_COUNT" },
+};
+
+} // namespace
+
+const char* cl_error_name(cl_int code)
+{
+  for (size_t i = 0; i < sizeof(kErrorNames) / sizeof(kErrorNames[0]); i++) {
+    if (kErrorNames[i].code == code) {
+      return kErrorNames[i].name;
+    }
+  }
+  return "CL_UNKNOWN_ERROR";
+}
+
+OpenCLError::OpenCLError(const std::string& function, cl_int code, const std::string& detail)
+: std::runtime_error(function + ": " + cl_error_name(code) + " (" + std::to_string(code) + ")" +
+                     (detail.empty() ? std::string() : "\n" + detail))
+, m_function(function)
+, m_code(code)
+{
+}
+
+ProgramBuildError::ProgramBuildError(cl_int code, const std::string& log)
+: OpenCLError("clBuildProgram", code, log)
+, m_log(log)
+{
+}
+
+std::string program_build_log(cl_program program, cl_device_id device)
+{
+  size_t size = 0;
+  if (clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &size) != CL_SUCCESS || size == 0) {
+    return std::string();
+  }
+  std::vector<char> log(size);
+  if (clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, size, &log[0], NULL) != CL_SUCCESS) {
+    return std::string();
+  }
+  return std::string(&log[0], strnlen(&log[0], size));
+}
@@ -0,0 +1,163 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CL_HANDLE_H__
+#define CL_HANDLE_H__
+
+#include <stddef.h>
+#include <stdexcept>
+#include <string>
+#include <OpenCL/opencl.h>
+
+// The CL_* name of an error code, e.g. "CL_OUT_OF_RESOURCES", or
+// "CL_UNKNOWN_ERROR" for codes this build doesn't know.
+const char* cl_error_name(cl_int code);
+
+// A failed OpenCL call. what() names the function and the error, e.g.
+// "clCreateBuffer: CL_MEM_OBJECT_ALLOCATION_FAILURE (-4)". Derives from
+// std::runtime_error, so handlers that predate it still catch it.
+class OpenCLError : public std::runtime_error {
+protected:
+    std::string m_function;
+    cl_int      m_code;
+
+public:
+    // A non-empty `detail` goes on the lines after the error in what().
+    OpenCLError(const std::string& function, cl_int code, const std::string& detail = std::string());
+
+    const std::string& function() const { return m_function; }
+    cl_int code() const { return m_code; }
+};
+
+// clBuildProgram failed; carries the compiler's build log for the device,
+// which is also appended to what().
+class ProgramBuildError : public OpenCLError {
+protected:
+    std::string m_log;
+
+public:
+    ProgramBuildError(cl_int code, const std::string& log);
+
+    const std::string& log() const { return m_log; }
+};
+
+// CL_PROGRAM_BUILD_LOG of `program` on `device`; empty if unavailable.
+std::string program_build_log(cl_program program, cl_device_id device);
+
+// Throws OpenCLError(function, code) unless code is CL_SUCCESS.
+inline void check_cl(cl_int code, const char* function)
+{
+  if (code != CL_SUCCESS) {
+    throw OpenCLError(function, code);
+  }
+}
+
+// How each OpenCL object type is released.
+template <typename T> struct ClRelease;
+template <> struct ClRelease<cl_context> { static void release(cl_context h) { clReleaseContext(h); } };
+template <> struct ClRelease<cl_command_queue> { static void release(cl_command_queue h) { clReleaseCommandQueue(h); } };
+template <> struct ClRelease<cl_program> { static void release(cl_program h) { clReleaseProgram(h); } };
+template <> struct ClRelease<cl_kernel> { static void release(cl_kernel h) { clReleaseKernel(h); } };
+template <> struct ClRelease<cl_mem> { static void release(cl_mem h) { clReleaseMemObject(h); } };
+template <> struct ClRelease<cl_event> { static void release(cl_event h) { clReleaseEvent(h); } };
+
+// Owns one reference to an OpenCL object and releases it when destroyed,
+// so an exception anywhere in a function cleans up whatever was created
+// before it. Move-only; get() borrows the handle, release() gives up
+// ownership, and out() is for the cl_event* and similar out-parameters.
+template <typename T>
+class ClHandle {
+protected:
+    T m_handle;
+
+public:
+    ClHandle() : m_handle(NULL) {}
+    explicit ClHandle(T handle) : m_handle(handle) {}
+    ClHandle(ClHandle&& other) : m_handle(other.release()) {}
+    ~ClHandle() { reset(); }
+
+    ClHandle& operator=(ClHandle&& other)
+    {
+      if (this != &other) {
+        reset(other.release());
+      }
+      return *this;
+    }
+
+    ClHandle(const ClHandle&) = delete;
+    ClHandle& operator=(const ClHandle&) = delete;
+
+    T get() const { return m_handle; }
+    explicit operator bool() const { return m_handle != NULL; }
+
+    T release()
+    {
+      T handle = m_handle;
+      m_handle = NULL;
+      return handle;
+    }
+
+    void reset(T handle = NULL)
+    {
+      if (m_handle) {
+        ClRelease<T>::release(m_handle);
+      }
+      m_handle = handle;
+    }
+
+    // Releases any current object and returns where a call can store a
+    // new one, e.g. clEnqueueWriteBuffer(..., event.out()).
+    T* out()
+    {
+      reset();
+      return &m_handle;
+    }
+};
+
+// Calls clFinish on a queue when destroyed. Declared after the buffers and
+// events a function enqueues commands with, it goes first on every exit,
+// so a failure never hands back a buffer the device may still be using.
+class QueueFinish {
+protected:
+    cl_command_queue m_queue;
+
+public:
+    explicit QueueFinish(cl_command_queue queue) : m_queue(queue) {}
+    ~QueueFinish() { clFinish(m_queue); }
+
+    QueueFinish(const QueueFinish&) = delete;
+    QueueFinish& operator=(const QueueFinish&) = delete;
+};
+
+typedef ClHandle<cl_context>        ContextHandle;
+typedef ClHandle<cl_command_queue>  QueueHandle;
+typedef ClHandle<cl_program>        ProgramHandle;
+typedef ClHandle<cl_kernel>         KernelHandle;
+typedef ClHandle<cl_mem>            MemHandle;
+typedef ClHandle<cl_event>          EventHandle;
+
+#endif // CL_HANDLE_H__
@@ -0,0 +1,134 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "concurrent_engine.h"
+#include "cl_handle.h"
+#include "opencl_engine.h"
+#include "trace.h"
+
+#include <stdexcept>
+
+ConcurrentEngine::ConcurrentEngine(OpenCLEngine& engine, size_t slots)
+: m_engine(engine)
+, m_next(0)
+, m_waiters(0)
+{
+  if (slots == 0) {
+    throw std::invalid_argument("ConcurrentEngine: needs at least one slot");
+  }
+  for (size_t i = 0; i < slots; i++) {
+    std::unique_ptr<Slot> slot(new Slot);
+    slot->queue.reset(engine.create_queue(CL_QUEUE_PROFILING_ENABLE));
+    slot->kernel.reset(engine.create_add_kernel());
+    slot->busy = false;
+    m_slots.push_back(std::move(slot));
+  }
+}
+
+// One pass over the slots, starting at a different one per call so that
+// concurrent callers don't all contend for slot 0.
+ConcurrentEngine::Slot* ConcurrentEngine::try_checkout()
+{
+  size_t start = m_next.fetch_add(1);
+  for (size_t i = 0; i < m_slots.size(); i++) {
+    Slot* slot = m_slots[(start + i) % m_slots.size()].get();
+    bool expected = false;
+    // The load is seq_cst, not relaxed: checkout() bumps m_waiters and then
+    // retries here, while checkin() clears busy and then reads m_waiters.
+    // Only with both sides sequentially consistent must one of them see
+    // the other; a relaxed load may be satisfied before the increment is
+    // visible (it is on ARM), and the waiter then sleeps through the only
+    // notification.
+    if (!slot->busy.load() && slot->busy.compare_exchange_strong(expected, true)) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+ConcurrentEngine::Slot* ConcurrentEngine::checkout()
+{
+  Slot* slot = try_checkout();
+  if (slot) {
+    return slot;
+  }
+
+  // Everything is busy. Registering as a waiter before the final retry
+  // means a checkin() either frees a slot that retry sees or notifies us.
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_waiters++;
+  while (!(slot = try_checkout())) {
+    m_available.wait(lock);
+  }
+  m_waiters--;
+  return slot;
+}
+
+void ConcurrentEngine::checkin(Slot* slot)
+{
+  slot->busy = false;
+  if (m_waiters > 0) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_available.notify_one();
+  }
+}
+
+double ConcurrentEngine::add(int* c, const int* a, const int* b, size_t N)
+{
+  if (N == 0) {
+    return 0.0;
+  }
+
+  // Declared in reverse order of release: the queue is finished before the
+  // events and buffers go, and the slot is checked in last.
+  Lease slot(*this);
+  size_t bytes = sizeof(int) * N;
+  BufferPool& pool = m_engine.pool();
+  PooledBuffer a_device(pool, bytes, CL_MEM_READ_ONLY);
+  PooledBuffer b_device(pool, bytes, CL_MEM_READ_ONLY);
+  PooledBuffer c_device(pool, bytes, CL_MEM_WRITE_ONLY);
+  EventHandle writes[2], kernel;
+  cl_command_queue queue = slot->queue.get();
+  QueueFinish finish(queue);
+
+  check_cl(clEnqueueWriteBuffer(queue, a_device.get(), CL_FALSE, 0, bytes, a, 0, NULL, writes[0].out()),
+           "clEnqueueWriteBuffer");
+  check_cl(clEnqueueWriteBuffer(queue, b_device.get(), CL_FALSE, 0, bytes, b, 0, NULL, writes[1].out()),
+           "clEnqueueWriteBuffer");
+
+  cl_event wait_list[2] = { writes[0].get(), writes[1].get() };
+  m_engine.enqueue_add(slot->kernel.get(), queue, c_device.get(), a_device.get(), b_device.get(), N,
+                       2, wait_list, kernel.out());
+
+  cl_event kernel_event = kernel.get();
+  check_cl(clEnqueueReadBuffer(queue, c_device.get(), CL_TRUE, 0, bytes, c, 1, &kernel_event, NULL),
+           "clEnqueueReadBuffer");
+  trace().device_span("write a", "transfer", writes[0].get());
+  trace().device_span("write b", "transfer", writes[1].get());
+  trace().device_span("kernel", "kernel", kernel_event);
+  return stage_timing(kernel_event).run_seconds();
+}
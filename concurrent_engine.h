@@ -0,0 +1,103 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef CONCURRENT_ENGINE_H__
+#define CONCURRENT_ENGINE_H__
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <OpenCL/opencl.h>
+
+#include "cl_handle.h"
+
+class OpenCLEngine;
+
+// Lets many host threads share one OpenCLEngine. Each slot has its own
+// command queue and its own instance of the add kernel, since cl_kernel
+// arguments are not safe to set from two threads at once. A caller checks a
+// slot out with one compare-and-swap and only blocks when every slot is
+// busy, so throughput scales with caller threads up to the number of slots
+// or until the device saturates.
+//
+// Configure the engine (kernel, local size, ELEMENTS_PER_ITEM) before
+// creating a ConcurrentEngine and leave it alone while one exists.
+class ConcurrentEngine {
+protected:
+    struct Slot {
+        QueueHandle         queue;
+        KernelHandle        kernel;
+        std::atomic<bool>   busy;
+    };
+
+    // A slot checked out for as long as the lease lives.
+    class Lease {
+    protected:
+        ConcurrentEngine&   m_owner;
+        Slot*               m_slot;
+
+    public:
+        explicit Lease(ConcurrentEngine& owner) : m_owner(owner), m_slot(owner.checkout()) {}
+        ~Lease() { m_owner.checkin(m_slot); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        Slot* operator->() const { return m_slot; }
+    };
+
+    OpenCLEngine&               m_engine;
+    std::vector<std::unique_ptr<Slot> > m_slots;
+    std::atomic<size_t>         m_next;         // where the next checkout starts looking
+    std::atomic<size_t>         m_waiters;      // callers blocked in checkout()
+    std::mutex                  m_mutex;
+    std::condition_variable     m_available;
+
+    Slot* try_checkout();
+    Slot* checkout();
+    void checkin(Slot* slot);
+
+private:
+    ConcurrentEngine(const ConcurrentEngine&);
+    ConcurrentEngine& operator=(const ConcurrentEngine&);
+
+public:
+    // `slots` queues and kernels on `engine`, whose device buffers pool the
+    // slots share.
+    ConcurrentEngine(OpenCLEngine& engine, size_t slots);
+
+    size_t slots() const { return m_slots.size(); }
+
+    // OpenCLEngine::add() that any number of threads may call at once.
+    // Returns the kernel execution time in seconds.
+    double add(int* c, const int* a, const int* b, size_t N);
+};
+
+#endif // CONCURRENT_ENGINE_H__
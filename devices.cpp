@@ -0,0 +1,280 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "devices.h"
+#include "cl_handle.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Returns 0 if `name` isn't a device type.
+cl_device_type parse_device_type(const std::string& name)
+{
+  if (name == "cpu") return CL_DEVICE_TYPE_CPU;
+  if (name == "gpu") return CL_DEVICE_TYPE_GPU;
+  if (name == "accelerator") return CL_DEVICE_TYPE_ACCELERATOR;
+  if (name == "all") return CL_DEVICE_TYPE_ALL;
+  return 0;
+}
+
+std::string device_type_name(cl_device_type type)
+{
+  if (type & CL_DEVICE_TYPE_GPU) return "GPU";
+  if (type & CL_DEVICE_TYPE_CPU) return "CPU";
+  if (type & CL_DEVICE_TYPE_ACCELERATOR) return "Accelerator";
+  return "Other";
+}
+
+template <typename T>
+T device_value(cl_device_id device, cl_device_info param)
+{
+  T value = T();
+  check_cl(clGetDeviceInfo(device, param, sizeof(value), &value, NULL), "clGetDeviceInfo");
+  return value;
+}
+
+std::string platform_name(cl_platform_id platform)
+{
+  size_t size = 0;
+  if (clGetPlatformInfo(platform, CL_PLATFORM_NAME, 0, NULL, &size) != CL_SUCCESS || size == 0) {
+    return std::string();
+  }
+  std::vector<char> value(size);
+  if (clGetPlatformInfo(platform, CL_PLATFORM_NAME, size, &value[0], NULL) != CL_SUCCESS) {
+    return std::string();
+  }
+  return std::string(&value[0]);
+}
+
+std::string lowercase(std::string text)
+{
+  for (size_t i = 0; i < text.size(); i++) {
+    text[i] = tolower((unsigned char)text[i]);
+  }
+  return text;
+}
+
+bool is_number(const std::string& text)
+{
+  if (text.empty()) {
+    return false;
+  }
+  for (size_t i = 0; i < text.size(); i++) {
+    if (!isdigit((unsigned char)text[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+std::vector<cl_device_id> enumerate_devices()
+{
+  cl_uint num_platforms = 0;
+  cl_int err = clGetPlatformIDs(0, NULL, &num_platforms);
+  if (err != CL_SUCCESS || num_platforms == 0) {
+    throw OpenCLError("clGetPlatformIDs", err);
+  }
+  std::vector<cl_platform_id> platforms(num_platforms);
+  err = clGetPlatformIDs(num_platforms, &platforms[0], NULL);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clGetPlatformIDs", err);
+  }
+
+  // A platform without devices (e.g. a GPU driver with no GPU present)
+  // reports CL_DEVICE_NOT_FOUND, which is not an error here.
+  std::vector<cl_device_id> devices;
+  for (size_t i = 0; i < platforms.size(); i++) {
+    cl_uint num_devices = 0;
+    if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 0, NULL, &num_devices) != CL_SUCCESS || num_devices == 0) {
+      continue;
+    }
+    std::vector<cl_device_id> platform_devices(num_devices);
+    if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, num_devices, &platform_devices[0], NULL) != CL_SUCCESS) {
+      continue;
+    }
+    devices.insert(devices.end(), platform_devices.begin(), platform_devices.end());
+  }
+  return devices;
+}
+
+std::vector<cl_device_id> select_devices(const std::string& selection)
+{
+  std::vector<cl_device_id> all_devices = enumerate_devices();
+  std::vector<cl_device_id> selected;
+
+  size_t begin = 0;
+  while (begin <= selection.size()) {
+    size_t end = selection.find(',', begin);
+    if (end == std::string::npos) {
+      end = selection.size();
+    }
+    std::string entry = selection.substr(begin, end - begin);
+    begin = end + 1;
+    if (entry.empty()) {
+      continue;
+    }
+
+    std::vector<cl_device_id> matches;
+    std::string type_name = entry;
+    std::string index_text;
+    size_t colon = entry.find(':');
+    if (colon != std::string::npos) {
+      type_name = entry.substr(0, colon);
+      index_text = entry.substr(colon + 1);
+    }
+
+    if (cl_device_type type = parse_device_type(type_name)) {
+      for (size_t i = 0; i < all_devices.size(); i++) {
+        if (device_value<cl_device_type>(all_devices[i], CL_DEVICE_TYPE) & type) {
+          matches.push_back(all_devices[i]);
+        }
+      }
+      if (!index_text.empty()) {
+        size_t index = strtoul(index_text.c_str(), NULL, 10);
+        if (!is_number(index_text) || index >= matches.size()) {
+          throw std::runtime_error("No device matches " + entry);
+        }
+        matches = std::vector<cl_device_id>(1, matches[index]);
+      }
+    } else if (is_number(entry)) {
+      size_t index = strtoul(entry.c_str(), NULL, 10);
+      if (index < all_devices.size()) {
+        matches.push_back(all_devices[index]);
+      }
+    } else {
+      std::string pattern = lowercase(entry);
+      for (size_t i = 0; i < all_devices.size(); i++) {
+        if (lowercase(device_name(all_devices[i])).find(pattern) != std::string::npos) {
+          matches.push_back(all_devices[i]);
+        }
+      }
+    }
+    if (matches.empty()) {
+      throw std::runtime_error("No device matches " + entry);
+    }
+
+    for (size_t i = 0; i < matches.size(); i++) {
+      if (std::find(selected.begin(), selected.end(), matches[i]) == selected.end()) {
+        selected.push_back(matches[i]);
+      }
+    }
+  }
+
+  if (selected.empty()) {
+    throw std::runtime_error("No devices selected");
+  }
+  return selected;
+}
+
+std::string device_string(cl_device_id device, cl_device_info param)
+{
+  size_t size = 0;
+  if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0) {
+    return std::string();
+  }
+  std::vector<char> value(size);
+  if (clGetDeviceInfo(device, param, size, &value[0], NULL) != CL_SUCCESS) {
+    return std::string();
+  }
+  return std::string(&value[0]);
+}
+
+std::string device_name(cl_device_id device)
+{
+  return device_string(device, CL_DEVICE_NAME);
+}
+
+std::string device_key(cl_device_id device)
+{
+  std::vector<cl_device_id> devices = enumerate_devices();
+  size_t index = std::find(devices.begin(), devices.end(), device) - devices.begin();
+
+  std::ostringstream key;
+  key << index << ": " << platform_name(device_value<cl_platform_id>(device, CL_DEVICE_PLATFORM))
+      << ", vendor 0x" << std::hex << device_value<cl_uint>(device, CL_DEVICE_VENDOR_ID)
+      << ", " << device_name(device);
+  return key.str();
+}
+
+DeviceInfo query_device(cl_device_id device)
+{
+  DeviceInfo info;
+  info.id = device;
+  info.index = 0;
+  info.platform = platform_name(device_value<cl_platform_id>(device, CL_DEVICE_PLATFORM));
+  info.name = device_string(device, CL_DEVICE_NAME);
+  info.vendor = device_string(device, CL_DEVICE_VENDOR);
+  info.version = device_string(device, CL_DEVICE_VERSION);
+  info.driver = device_string(device, CL_DRIVER_VERSION);
+  info.type = device_value<cl_device_type>(device, CL_DEVICE_TYPE);
+  info.compute_units = device_value<cl_uint>(device, CL_DEVICE_MAX_COMPUTE_UNITS);
+  info.max_clock_mhz = device_value<cl_uint>(device, CL_DEVICE_MAX_CLOCK_FREQUENCY);
+  info.global_mem_size = device_value<cl_ulong>(device, CL_DEVICE_GLOBAL_MEM_SIZE);
+  info.local_mem_size = device_value<cl_ulong>(device, CL_DEVICE_LOCAL_MEM_SIZE);
+  info.max_alloc_size = device_value<cl_ulong>(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+  info.max_work_group_size = device_value<size_t>(device, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+  info.preferred_vector_width_int = device_value<cl_uint>(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT);
+  info.host_unified_memory = device_value<cl_bool>(device, CL_DEVICE_HOST_UNIFIED_MEMORY) != CL_FALSE;
+  return info;
+}
+
+std::vector<DeviceInfo> discover_devices()
+{
+  std::vector<cl_device_id> devices = enumerate_devices();
+  std::vector<DeviceInfo> infos;
+  for (size_t i = 0; i < devices.size(); i++) {
+    infos.push_back(query_device(devices[i]));
+    infos.back().index = i;
+  }
+  return infos;
+}
+
+void print_devices(std::ostream& out, const std::vector<DeviceInfo>& devices)
+{
+  for (size_t i = 0; i < devices.size(); i++) {
+    const DeviceInfo& info = devices[i];
+    out << "[" << info.index << "] " << info.name << " (" << device_type_name(info.type) << ", " << info.platform << ")\n"
+        << "    vendor:                 " << info.vendor << "\n"
+        << "    version:                " << info.version << ", driver " << info.driver << "\n"
+        << "    compute units:          " << info.compute_units << " @ " << info.max_clock_mhz << " MHz\n"
+        << "    global memory:          " << (info.global_mem_size >> 20) << " MiB"
+        << " (max allocation " << (info.max_alloc_size >> 20) << " MiB)\n"
+        << "    local memory:           " << (info.local_mem_size >> 10) << " KiB\n"
+        << "    max work-group size:    " << info.max_work_group_size << "\n"
+        << "    preferred int vector:   " << info.preferred_vector_width_int << "\n"
+        << "    host unified memory:    " << (info.host_unified_memory ? "yes" : "no") << "\n";
+  }
+  out.flush();
+}
@@ -0,0 +1,87 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef DEVICES_H__
+#define DEVICES_H__
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <OpenCL/opencl.h>
+
+// Capabilities of one device, as reported by clGetDeviceInfo.
+struct DeviceInfo {
+    cl_device_id    id;
+    size_t          index;              // position in enumerate_devices()
+    std::string     platform;
+    std::string     name;
+    std::string     vendor;
+    std::string     version;
+    std::string     driver;
+    cl_device_type  type;
+    cl_uint         compute_units;
+    cl_uint         max_clock_mhz;
+    cl_ulong        global_mem_size;
+    cl_ulong        local_mem_size;
+    cl_ulong        max_alloc_size;
+    size_t          max_work_group_size;
+    cl_uint         preferred_vector_width_int;
+    bool            host_unified_memory;
+};
+
+// Every device of every platform, in platform order.
+std::vector<cl_device_id> enumerate_devices();
+
+DeviceInfo query_device(cl_device_id device);
+
+// query_device() for everything enumerate_devices() returns.
+std::vector<DeviceInfo> discover_devices();
+
+// Prints one block per device with the capabilities relevant to picking one.
+void print_devices(std::ostream& out, const std::vector<DeviceInfo>& devices);
+
+// Resolves a comma-separated device selection list. Each entry is one of:
+//   - a device type ("cpu", "gpu", "accelerator" or "all"), optionally
+//     followed by ":<index>" to pick one device of that type ("gpu:1");
+//   - a number, the device's index in discover_devices() / --list-devices;
+//   - anything else, matched case-insensitively against device names.
+// Duplicates are dropped; throws if an entry matches nothing. Picking the
+// fastest device needs a calibration run, see fastest_device().
+std::vector<cl_device_id> select_devices(const std::string& selection);
+
+std::string device_name(cl_device_id device);
+
+// Identifies `device` among identical ones on this machine: its index in
+// enumerate_devices(), platform, CL_DEVICE_VENDOR_ID and name, e.g.
+// "1: NVIDIA CUDA, vendor 0x10de, GeForce GTX 1080". Stable as long as the
+// installed platforms and devices don't change.
+std::string device_key(cl_device_id device);
+
+// String-valued clGetDeviceInfo query; empty if the query fails.
+std::string device_string(cl_device_id device, cl_device_info param);
+
+#endif // DEVICES_H__
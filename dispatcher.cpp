@@ -0,0 +1,208 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "dispatcher.h"
+#include "devices.h"
+#include "native_add.h"
+#include "opencl_engine.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Timed runs per calibration size; the median is used.
+static const size_t kCalibrationRepetitions = 5;
+
+const char* backend_name(Backend backend)
+{
+  switch (backend) {
+    case BACKEND_HOST:
+      return "host";
+    case BACKEND_OPENCL_CPU:
+      return "opencl-cpu";
+    case BACKEND_OPENCL_GPU:
+      return "opencl-gpu";
+    default:
+      return "unknown";
+  }
+}
+
+CostModel fit_cost_model(const std::vector<size_t>& sizes, const std::vector<double>& seconds)
+{
+  if (sizes.size() != seconds.size() || sizes.size() < 2) {
+    throw std::invalid_argument("fit_cost_model: needs two or more matching samples");
+  }
+
+  // Weight each residual by 1/seconds^2, i.e. fit relative rather than
+  // absolute error. Unweighted, the largest sizes dominate and the latency
+  // comes out as their noise, often negative; weighted, the small sizes
+  // (which are mostly latency) pin the intercept and the large ones the
+  // slope.
+  double sum_w = 0.0;
+  double sum_x = 0.0;
+  double sum_y = 0.0;
+  double sum_xx = 0.0;
+  double sum_xy = 0.0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    double x = 3.0 * sizeof(int) * sizes[i];
+    double y = seconds[i];
+    double w = 1.0 / std::max(y * y, 1e-18);
+    sum_w += w;
+    sum_x += w * x;
+    sum_y += w * y;
+    sum_xx += w * x * x;
+    sum_xy += w * x * y;
+  }
+
+  CostModel model;
+  double denominator = sum_w * sum_xx - sum_x * sum_x;
+  double slope = denominator > 0.0 ? (sum_w * sum_xy - sum_x * sum_y) / denominator : 0.0;
+  double intercept = (sum_y - slope * sum_x) / sum_w;
+  if (intercept < 0.0) {
+    // Refit through the origin rather than predict negative time.
+    intercept = 0.0;
+    slope = sum_xx > 0.0 ? sum_xy / sum_xx : 0.0;
+  }
+  if (slope <= 0.0) {
+    // Timings didn't grow with N (all noise); treat the largest size as
+    // pure transfer so the model still ranks backends sensibly.
+    size_t largest = std::max_element(sizes.begin(), sizes.end()) - sizes.begin();
+    slope = seconds[largest] / (3.0 * sizeof(int) * std::max(sizes[largest], (size_t)1));
+  }
+  model.latency_seconds = intercept;
+  model.bytes_per_second = slope > 0.0 ? 1.0 / slope : 0.0;
+  return model;
+}
+
+Dispatcher::Dispatcher(const std::string& cache_dir, size_t calibration_N)
+{
+  for (size_t i = 0; i < BACKEND_COUNT; i++) {
+    m_engines[i] = NULL;
+    m_dispatched[i] = 0;
+  }
+
+  try {
+    std::vector<DeviceInfo> devices = discover_devices();
+    for (size_t i = 0; i < devices.size(); i++) {
+      Backend backend = (devices[i].type & CL_DEVICE_TYPE_GPU) ? BACKEND_OPENCL_GPU
+                      : (devices[i].type & CL_DEVICE_TYPE_CPU) ? BACKEND_OPENCL_CPU : BACKEND_HOST;
+      if (backend != BACKEND_HOST && !m_engines[backend]) {
+        m_engines[backend] = new OpenCLEngine(devices[i].id, cache_dir);
+      }
+    }
+    calibrate(calibration_N);
+  } catch (...) {
+    release();
+    throw;
+  }
+}
+
+Dispatcher::~Dispatcher()
+{
+  release();
+}
+
+void Dispatcher::release()
+{
+  for (size_t i = 0; i < BACKEND_COUNT; i++) {
+    delete m_engines[i];
+    m_engines[i] = NULL;
+  }
+}
+
+double Dispatcher::time_add(Backend backend, int* c, const int* a, const int* b, size_t N)
+{
+  Timer timer;
+  timer.start();
+  if (backend == BACKEND_HOST) {
+    native_add(c, a, b, N);
+  } else {
+    m_engines[backend]->add(c, a, b, N);
+  }
+  timer.stop();
+  return timer.elapsed();
+}
+
+void Dispatcher::calibrate(size_t max_N)
+{
+  std::vector<size_t> sizes;
+  for (size_t N = 1024; N <= max_N; N *= 8) {
+    sizes.push_back(N);
+  }
+  if (sizes.size() < 2) {
+    sizes.clear();
+    sizes.push_back(std::max(max_N / 8, (size_t)1));
+    sizes.push_back(std::max(max_N, (size_t)2));
+  }
+
+  size_t largest = sizes.back();
+  std::vector<int> a(largest, 1);
+  std::vector<int> b(largest, 2);
+  std::vector<int> c(largest);
+
+  for (size_t backend = 0; backend < BACKEND_COUNT; backend++) {
+    if (!available((Backend)backend)) {
+      continue;
+    }
+    // Warm up at the largest size so buffer allocation isn't measured.
+    time_add((Backend)backend, &c[0], &a[0], &b[0], largest);
+
+    std::vector<double> seconds;
+    for (size_t s = 0; s < sizes.size(); s++) {
+      SampleStats samples;
+      for (size_t r = 0; r < kCalibrationRepetitions; r++) {
+        samples.add(time_add((Backend)backend, &c[0], &a[0], &b[0], sizes[s]));
+      }
+      seconds.push_back(samples.median());
+    }
+    m_models[backend] = fit_cost_model(sizes, seconds);
+  }
+}
+
+Backend Dispatcher::choose(size_t N) const
+{
+  Backend best = BACKEND_HOST;
+  for (size_t backend = 0; backend < BACKEND_COUNT; backend++) {
+    if (available((Backend)backend) && m_models[backend].calibrated() &&
+        (!m_models[best].calibrated() || m_models[backend].seconds(N) < m_models[best].seconds(N))) {
+      best = (Backend)backend;
+    }
+  }
+  return best;
+}
+
+Backend Dispatcher::add(int* c, const int* a, const int* b, size_t N)
+{
+  Backend backend = choose(N);
+  if (backend == BACKEND_HOST) {
+    native_add(c, a, b, N);
+  } else {
+    m_engines[backend]->add(c, a, b, N);
+  }
+  m_dispatched[backend]++;
+  return backend;
+}
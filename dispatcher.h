@@ -0,0 +1,108 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef DISPATCHER_H__
+#define DISPATCHER_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class OpenCLEngine;
+
+// Where Dispatcher::add() can run an add.
+enum Backend {
+    BACKEND_HOST,       // native_add()
+    BACKEND_OPENCL_CPU, // the first OpenCL CPU device
+    BACKEND_OPENCL_GPU, // the first OpenCL GPU device
+    BACKEND_COUNT
+};
+
+const char* backend_name(Backend backend);
+
+// Predicted time of an N-element add: a fixed launch latency plus the bytes
+// moved (a, b and c) at a sustained bandwidth. Both are fitted to measured
+// end-to-end times.
+struct CostModel {
+    double  latency_seconds;
+    double  bytes_per_second;
+
+    CostModel() : latency_seconds(0.0), bytes_per_second(0.0) {}
+
+    bool calibrated() const { return bytes_per_second > 0.0; }
+    double seconds(size_t N) const { return latency_seconds + 3.0 * sizeof(int) * N / bytes_per_second; }
+};
+
+// Least-squares fit of seconds = latency + bytes / bandwidth to timings of
+// N-element adds, minimizing relative error so the latency is fitted to
+// the small sizes. The latency is clamped to be non-negative.
+CostModel fit_cost_model(const std::vector<size_t>& sizes, const std::vector<double>& seconds);
+
+// Front end that sends each add to whichever backend the cost models say is
+// fastest for its N: small requests stay on the host, where there is no
+// launch or transfer cost, and large ones go to a device. Engines are created
+// once, so per-request costs are only transfers and the launch itself.
+class Dispatcher {
+protected:
+    OpenCLEngine*   m_engines[BACKEND_COUNT];   // NULL for the host and missing devices
+    CostModel       m_models[BACKEND_COUNT];
+    size_t          m_dispatched[BACKEND_COUNT];
+
+    double time_add(Backend backend, int* c, const int* a, const int* b, size_t N);
+    void release();
+
+private:
+    Dispatcher(const Dispatcher&);
+    Dispatcher& operator=(const Dispatcher&);
+
+public:
+    // Sets up an engine for the first CPU and the first GPU device found,
+    // whichever exist, and calibrates all backends with sizes up to
+    // `calibration_N`.
+    explicit Dispatcher(const std::string& cache_dir, size_t calibration_N = 16 * 1024 * 1024);
+    ~Dispatcher();
+
+    bool available(Backend backend) const { return backend == BACKEND_HOST || m_engines[backend] != NULL; }
+    OpenCLEngine* engine(Backend backend) { return m_engines[backend]; }
+    const CostModel& model(Backend backend) const { return m_models[backend]; }
+
+    // Number of adds routed to `backend` so far.
+    size_t dispatched(Backend backend) const { return m_dispatched[backend]; }
+
+    // Re-measures every available backend at sizes from 1K elements up to
+    // `max_N` and refits the cost models. Runs from the constructor; call it
+    // again if the machine's load changes.
+    void calibrate(size_t max_N);
+
+    // The available backend with the lowest predicted time for N elements.
+    Backend choose(size_t N) const;
+
+    // Computes c = a + b on choose(N) and returns the backend used.
+    Backend add(int* c, const int* a, const int* b, size_t N);
+};
+
+#endif // DISPATCHER_H__
@@ -0,0 +1,313 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "expr.h"
+#include "cl_handle.h"
+#include "opencl_engine.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+struct Expr::Node {
+    enum Kind { ARRAY, SCALAR, CONSTANT, UNARY, BINARY, CALL };
+
+    Kind                        kind;
+    std::string                 name;       // input name, operator or function
+    double                      value;      // CONSTANT
+    std::shared_ptr<const Node> left;
+    std::shared_ptr<const Node> right;
+
+    Node(Kind kind_, const std::string& name_) : kind(kind_), name(name_), value(0.0) {}
+};
+
+namespace {
+
+typedef std::shared_ptr<const Expr::Node> NodePtr;
+
+bool is_identifier(const std::string& name)
+{
+  if (name.empty() || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+    return false;
+  }
+  for (size_t i = 1; i < name.size(); i++) {
+    if (!(isalnum((unsigned char)name[i]) || name[i] == '_')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool is_floating(const std::string& type)
+{
+  return type == "float" || type == "double";
+}
+
+std::string node_code(const NodePtr& node, const std::string& type)
+{
+  switch (node->kind) {
+    case Expr::Node::ARRAY:
+      return "in_" + node->name + "[i]";
+    case Expr::Node::SCALAR:
+      return "s_" + node->name;
+    case Expr::Node::CONSTANT: {
+      // Cast so a float expression never needs double support.
+      std::ostringstream literal;
+      literal.precision(17);
+      literal << "((" << type << ")" << node->value << ")";
+      return literal.str();
+    }
+    case Expr::Node::UNARY:
+      return "(" + node->name + node_code(node->left, type) + ")";
+    case Expr::Node::BINARY:
+      return "(" + node_code(node->left, type) + " " + node->name + " " + node_code(node->right, type) + ")";
+    case Expr::Node::CALL: {
+      std::string function = is_floating(type) ? "f" + node->name : node->name;
+      return function + "(" + node_code(node->left, type) + ", " + node_code(node->right, type) + ")";
+    }
+  }
+  return std::string();
+}
+
+void collect_inputs(const NodePtr& node, std::vector<std::string>* arrays, std::vector<std::string>* scalars)
+{
+  if (!node) {
+    return;
+  }
+  if (node->kind == Expr::Node::ARRAY || node->kind == Expr::Node::SCALAR) {
+    std::vector<std::string>* names = node->kind == Expr::Node::ARRAY ? arrays : scalars;
+    std::vector<std::string>* others = node->kind == Expr::Node::ARRAY ? scalars : arrays;
+    if (std::find(others->begin(), others->end(), node->name) != others->end()) {
+      throw std::invalid_argument("Expr: " + node->name + " is used as both an array and a scalar");
+    }
+    if (std::find(names->begin(), names->end(), node->name) == names->end()) {
+      names->push_back(node->name);
+    }
+  }
+  collect_inputs(node->left, arrays, scalars);
+  collect_inputs(node->right, arrays, scalars);
+}
+
+NodePtr input_node(Expr::Node::Kind kind, const std::string& name)
+{
+  if (!is_identifier(name)) {
+    throw std::invalid_argument("Expr: input name '" + name + "' is not an identifier");
+  }
+  return std::make_shared<Expr::Node>(kind, name);
+}
+
+} // namespace
+
+namespace {
+
+Expr combine(Expr::Node::Kind kind, const std::string& op, const Expr& left, const NodePtr& right)
+{
+  std::shared_ptr<Expr::Node> node = std::make_shared<Expr::Node>(kind, op);
+  node->left = left.node();
+  node->right = right;
+  return Expr(NodePtr(node));
+}
+
+} // namespace
+
+Expr::Expr(double constant)
+{
+  // operator<< would write "nan" or "inf", which OpenCL C doesn't accept,
+  // and the integer types have no such values at all.
+  if (!isfinite(constant)) {
+    throw std::invalid_argument("Expr: constant must be finite");
+  }
+  std::shared_ptr<Node> node = std::make_shared<Node>(Node::CONSTANT, std::string());
+  node->value = constant;
+  m_node = node;
+}
+
+Expr Expr::array(const std::string& name)
+{
+  return Expr(input_node(Node::ARRAY, name));
+}
+
+Expr Expr::scalar(const std::string& name)
+{
+  return Expr(input_node(Node::SCALAR, name));
+}
+
+std::string Expr::code(const std::string& type) const
+{
+  return node_code(m_node, type);
+}
+
+void Expr::inputs(std::vector<std::string>* arrays, std::vector<std::string>* scalars) const
+{
+  collect_inputs(m_node, arrays, scalars);
+}
+
+Expr operator+(const Expr& x, const Expr& y)
+{
+  return combine(Expr::Node::BINARY, "+", x, y.node());
+}
+
+Expr operator-(const Expr& x, const Expr& y)
+{
+  return combine(Expr::Node::BINARY, "-", x, y.node());
+}
+
+Expr operator*(const Expr& x, const Expr& y)
+{
+  return combine(Expr::Node::BINARY, "*", x, y.node());
+}
+
+Expr operator/(const Expr& x, const Expr& y)
+{
+  return combine(Expr::Node::BINARY, "/", x, y.node());
+}
+
+Expr operator-(const Expr& x)
+{
+  return combine(Expr::Node::UNARY, "-", x, NodePtr());
+}
+
+Expr minimum(const Expr& x, const Expr& y)
+{
+  return combine(Expr::Node::CALL, "min", x, y.node());
+}
+
+Expr maximum(const Expr& x, const Expr& y)
+{
+  return combine(Expr::Node::CALL, "max", x, y.node());
+}
+
+std::string fused_kernel_source(const Expr& expr, const std::string& type)
+{
+  std::vector<std::string> arrays;
+  std::vector<std::string> scalars;
+  expr.inputs(&arrays, &scalars);
+
+  std::ostringstream source;
+  if (type == "double") {
+    source << "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n";
+  }
+  source << "__kernel void fused(__global " << type << "* out";
+  for (size_t i = 0; i < arrays.size(); i++) {
+    source << ", __global const " << type << "* in_" << arrays[i];
+  }
+  for (size_t i = 0; i < scalars.size(); i++) {
+    source << ", const " << type << " s_" << scalars[i];
+  }
+  source << ", const uint n)\n"
+         << "{\n"
+         << "   uint i = get_global_id(0);\n"
+         << "   if (i < n) {\n"
+         << "      out[i] = " << expr.code(type) << ";\n"
+         << "   }\n"
+         << "}\n";
+  return source.str();
+}
+
+FusedProgram::FusedProgram(OpenCLEngine& engine, const Expr& expr, const std::string& type, size_t element_size)
+: m_engine(engine)
+, m_element_size(element_size)
+, m_max_local_size(1)
+{
+  if (type == "half") {
+    throw std::invalid_argument("FusedKernel: half has no device arithmetic without cl_khr_fp16");
+  }
+  expr.inputs(&m_arrays, &m_scalars);
+  m_source = fused_kernel_source(expr, type);
+
+  m_program.reset(engine.cache().build(engine.context(), engine.device(), m_source, std::string(), &m_build_info));
+  cl_int err = CL_SUCCESS;
+  m_kernel.reset(clCreateKernel(m_program.get(), "fused", &err));
+  if (!m_kernel || err != CL_SUCCESS) {
+    throw OpenCLError("clCreateKernel", err);
+  }
+  check_cl(clGetKernelWorkGroupInfo(m_kernel.get(), engine.device(), CL_KERNEL_WORK_GROUP_SIZE, sizeof(m_max_local_size),
+                                    &m_max_local_size, NULL), "clGetKernelWorkGroupInfo");
+}
+
+double FusedProgram::run(void* out, const std::vector<const void*>& arrays, const std::vector<const void*>& scalars,
+                         size_t N)
+{
+  if (arrays.size() != m_arrays.size() || scalars.size() != m_scalars.size()) {
+    throw std::invalid_argument("FusedKernel::run: wrong number of arrays or scalars");
+  }
+  if (N > CL_UINT_MAX) {
+    throw std::invalid_argument("FusedKernel::run: N exceeds 32-bit kernel indexing");
+  }
+  if (N == 0) {
+    return 0.0;
+  }
+
+  BufferPool& pool = m_engine.pool();
+  cl_command_queue queue = m_engine.queue();
+  size_t bytes = m_element_size * N;
+  std::vector<PooledBuffer> buffers;    // out, then the inputs
+  std::vector<EventHandle> writes;
+  EventHandle kernel;
+  buffers.reserve(arrays.size() + 1);
+  writes.reserve(arrays.size());
+  QueueFinish finish(queue);
+
+  buffers.push_back(PooledBuffer(pool, bytes, CL_MEM_WRITE_ONLY));
+  for (size_t i = 0; i < arrays.size(); i++) {
+    buffers.push_back(PooledBuffer(pool, bytes, CL_MEM_READ_ONLY));
+    writes.push_back(EventHandle());
+    check_cl(clEnqueueWriteBuffer(queue, buffers.back().get(), CL_FALSE, 0, bytes, arrays[i], 0, NULL,
+                                  writes.back().out()), "clEnqueueWriteBuffer");
+  }
+
+  cl_kernel fused = m_kernel.get();
+  cl_uint arg = 0;
+  cl_int err = CL_SUCCESS;
+  for (size_t i = 0; i < buffers.size(); i++) {
+    cl_mem buffer = buffers[i].get();
+    err |= clSetKernelArg(fused, arg++, sizeof(cl_mem), &buffer);
+  }
+  for (size_t i = 0; i < scalars.size(); i++) {
+    err |= clSetKernelArg(fused, arg++, m_element_size, scalars[i]);
+  }
+  cl_uint n = (cl_uint)N;
+  err |= clSetKernelArg(fused, arg++, sizeof(cl_uint), &n);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clSetKernelArg", err);
+  }
+
+  std::vector<cl_event> wait_list;
+  for (size_t i = 0; i < writes.size(); i++) {
+    wait_list.push_back(writes[i].get());
+  }
+  size_t local_size = m_max_local_size;
+  size_t global_size = (N + local_size - 1) / local_size * local_size;
+  check_cl(clEnqueueNDRangeKernel(queue, fused, 1, NULL, &global_size, &local_size, (cl_uint)wait_list.size(),
+                                  wait_list.empty() ? NULL : &wait_list[0], kernel.out()), "clEnqueueNDRangeKernel");
+  cl_event kernel_event = kernel.get();
+  check_cl(clEnqueueReadBuffer(queue, buffers[0].get(), CL_TRUE, 0, bytes, out, 1, &kernel_event, NULL),
+           "clEnqueueReadBuffer");
+  return stage_timing(kernel_event).run_seconds();
+}
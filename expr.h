@@ -0,0 +1,151 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef EXPR_H__
+#define EXPR_H__
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <OpenCL/opencl.h>
+
+#include "cl_handle.h"
+#include "typed_add.h"
+
+class OpenCLEngine;
+
+// An elementwise expression over named arrays and scalars, built with the
+// usual operators, e.g.
+//
+//   Expr a = Expr::array("a"), b = Expr::array("b"), c = Expr::array("c");
+//   Expr s = Expr::scalar("s");
+//   Expr d = (a + b) * s + c;
+//
+// FusedKernel turns one into a single OpenCL kernel, so a chain of ops
+// costs one pass over memory and one launch, with no intermediate buffers.
+// Exprs are immutable and cheap to copy; subexpressions are shared.
+class Expr {
+public:
+    struct Node;
+
+protected:
+    std::shared_ptr<const Node> m_node;
+
+public:
+    // A literal, so that `a * 2.0` works. Throws std::invalid_argument for
+    // NaN and infinities.
+    Expr(double constant);
+
+    // Node is private to expr.cpp; these are for the operators there.
+    explicit Expr(const std::shared_ptr<const Node>& node) : m_node(node) {}
+    const std::shared_ptr<const Node>& node() const { return m_node; }
+
+    // An input array / per-launch scalar. Names must be C identifiers;
+    // using the same name twice refers to the same input.
+    static Expr array(const std::string& name);
+    static Expr scalar(const std::string& name);
+
+    // OpenCL C for the value at index `i`, with inputs named `in_<name>[i]`
+    // and `s_<name>` and literals cast to `type`.
+    std::string code(const std::string& type) const;
+
+    // Input names in order of first appearance, without duplicates.
+    void inputs(std::vector<std::string>* arrays, std::vector<std::string>* scalars) const;
+};
+
+Expr operator+(const Expr& x, const Expr& y);
+Expr operator-(const Expr& x, const Expr& y);
+Expr operator*(const Expr& x, const Expr& y);
+Expr operator/(const Expr& x, const Expr& y);
+Expr operator-(const Expr& x);
+
+// Elementwise fmin/fmax for floating types, min/max for integer ones.
+Expr minimum(const Expr& x, const Expr& y);
+Expr maximum(const Expr& x, const Expr& y);
+
+// Kernel source computing `out[i] = expr` for elements of OpenCL C `type`.
+std::string fused_kernel_source(const Expr& expr, const std::string& type);
+
+// Untyped part of FusedKernel<T>.
+class FusedProgram {
+protected:
+    OpenCLEngine&               m_engine;
+    std::string                 m_source;
+    std::vector<std::string>    m_arrays;
+    std::vector<std::string>    m_scalars;
+    size_t                      m_element_size;
+    ProgramHandle               m_program;
+    KernelHandle                m_kernel;
+    size_t                      m_max_local_size;
+    ProgramBuildInfo            m_build_info;
+
+    FusedProgram(OpenCLEngine& engine, const Expr& expr, const std::string& type, size_t element_size);
+
+    // `arrays` and `scalars` follow arrays() and scalars(); each scalar is
+    // m_element_size bytes.
+    double run(void* out, const std::vector<const void*>& arrays, const std::vector<const void*>& scalars, size_t N);
+
+private:
+    FusedProgram(const FusedProgram&);
+    FusedProgram& operator=(const FusedProgram&);
+
+public:
+    const std::string& source() const { return m_source; }
+    const ProgramBuildInfo& build_info() const { return m_build_info; }
+
+    // Kernel parameters, in the order run() takes them.
+    const std::vector<std::string>& arrays() const { return m_arrays; }
+    const std::vector<std::string>& scalars() const { return m_scalars; }
+};
+
+// An Expr compiled for element type T (any DeviceType except Half, which
+// has no device arithmetic without cl_khr_fp16). The program goes through
+// the engine's program cache, so the same expression and type only compile
+// once per device.
+template <typename T>
+class FusedKernel : public FusedProgram {
+public:
+    FusedKernel(OpenCLEngine& engine, const Expr& expr)
+    : FusedProgram(engine, expr, DeviceType<T>::name(), sizeof(T))
+    {
+    }
+
+    // out[i] = expr for i in [0, N), uploading each array once and reading
+    // `out` back. Returns the kernel execution time in seconds.
+    double run(T* out, const std::vector<const T*>& arrays, const std::vector<T>& scalars, size_t N)
+    {
+      std::vector<const void*> array_ptrs(arrays.begin(), arrays.end());
+      std::vector<const void*> scalar_ptrs;
+      for (size_t i = 0; i < scalars.size(); i++) {
+        scalar_ptrs.push_back(&scalars[i]);
+      }
+      return FusedProgram::run(out, array_ptrs, scalar_ptrs, N);
+    }
+};
+
+#endif // EXPR_H__
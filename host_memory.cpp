@@ -0,0 +1,219 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "host_memory.h"
+#include "host_ops.h"
+#include "timer.h"
+#include "trace.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+// The common huge page size on x86-64 and arm64 Linux.
+static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t host_page_size()
+{
+  long page_size = sysconf(_SC_PAGESIZE);
+  return page_size > 0 ? (size_t)page_size : 4096;
+}
+
+void* allocate_aligned(size_t bytes, size_t alignment)
+{
+  if (alignment < sizeof(void*)) {
+    alignment = sizeof(void*);
+  }
+  size_t rounded = (bytes + alignment - 1) / alignment * alignment;
+
+  void* block = NULL;
+  if (posix_memalign(&block, alignment, rounded ? rounded : alignment) != 0) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void free_aligned(void* block)
+{
+  free(block);
+}
+
+HostArena::HostArena(bool huge_pages)
+: m_huge_pages(huge_pages)
+{
+}
+
+HostArena::~HostArena()
+{
+  trim();
+  for (std::map<void*, Block>::iterator it = m_in_use.begin(); it != m_in_use.end(); ++it) {
+    unmap_block(it->second);
+  }
+}
+
+void HostArena::set_huge_pages(bool huge_pages)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_huge_pages = huge_pages;
+}
+
+HostArena::Block HostArena::map_block(size_t size, size_t alignment, bool huge_pages) const
+{
+  Block block = { NULL, size, false };
+#ifdef MAP_HUGETLB
+  if (huge_pages && alignment <= kHugePageSize) {
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data != MAP_FAILED) {
+      block.data = data;
+      block.huge = true;
+      return block;
+    }
+  }
+#endif
+
+  // mmap only promises page alignment, so map the excess and trim both
+  // ends. Aligning to the huge page size lets the kernel back the block
+  // with transparent huge pages.
+  size_t page_size = host_page_size();
+  size_t align = std::max(alignment, huge_pages ? kHugePageSize : page_size);
+  size_t extra = align - page_size;
+  void* mapped = mmap(NULL, size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  char* begin = (char*)mapped;
+  char* data = (char*)(((uintptr_t)begin + align - 1) / align * align);
+  if (data > begin) {
+    munmap(begin, data - begin);
+  }
+  if (begin + size + extra > data + size) {
+    munmap(data + size, begin + size + extra - (data + size));
+  }
+  block.data = data;
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    block.huge = madvise(data, size, MADV_HUGEPAGE) == 0;
+  }
+#endif
+  return block;
+}
+
+void HostArena::unmap_block(const Block& block) const
+{
+  munmap(block.data, block.size);
+}
+
+void* HostArena::acquire(size_t bytes, size_t alignment)
+{
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    throw std::invalid_argument("HostArena::acquire: alignment must be a power of two");
+  }
+  size_t page_size = host_page_size();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  bool huge_pages = m_huge_pages;
+  size_t granule = huge_pages ? kHugePageSize : page_size;
+  size_t size = (std::max(bytes, (size_t)1) + granule - 1) / granule * granule;
+
+  // Take the smallest free block that fits, unless it would waste more
+  // than it uses.
+  std::multimap<size_t, Block>::iterator it = m_free.lower_bound(size);
+  for (; it != m_free.end() && it->first <= 2 * size; ++it) {
+    if ((uintptr_t)it->second.data % alignment == 0) {
+      Block block = it->second;
+      m_free.erase(it);
+      m_in_use[block.data] = block;
+      m_stats.reuses++;
+      return block.data;
+    }
+  }
+
+  // Mapping and faulting in can take a while; don't block other threads.
+  lock.unlock();
+  Block block = map_block(size, alignment, huge_pages);
+  Timer timer;
+  {
+    TraceScope scope("first touch", "alloc");
+    timer.start();
+    char* data = (char*)block.data;
+    parallel_for(0, block.size / page_size, [data, page_size](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        ((volatile char*)data)[i * page_size] = 0;
+      }
+    });
+    timer.stop();
+  }
+
+  lock.lock();
+  m_in_use[block.data] = block;
+  m_stats.blocks++;
+  m_stats.bytes_mapped += block.size;
+  m_stats.huge_page_advised_bytes += block.huge ? block.size : 0;
+  m_stats.first_touch_seconds += timer.elapsed();
+  return block.data;
+}
+
+void HostArena::release(void* data)
+{
+  if (!data) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::map<void*, Block>::iterator it = m_in_use.find(data);
+  if (it == m_in_use.end()) {
+    throw std::runtime_error("HostArena::release: block not from this arena");
+  }
+  m_free.insert(std::make_pair(it->second.size, it->second));
+  m_in_use.erase(it);
+}
+
+void HostArena::trim()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (std::multimap<size_t, Block>::iterator it = m_free.begin(); it != m_free.end(); ++it) {
+    unmap_block(it->second);
+    m_stats.bytes_mapped -= it->second.size;
+    m_stats.huge_page_advised_bytes -= it->second.huge ? it->second.size : 0;
+  }
+  m_free.clear();
+}
+
+HostArenaStats HostArena::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+HostArena& host_arena()
+{
+  static HostArena arena;
+  return arena;
+}
@@ -0,0 +1,111 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef HOST_MEMORY_H__
+#define HOST_MEMORY_H__
+
+#include <stddef.h>
+#include <map>
+#include <mutex>
+
+// Size of a virtual memory page on this host.
+size_t host_page_size();
+
+// Allocates `bytes` bytes aligned to `alignment` (a power of two), with the
+// size rounded up to a whole number of `alignment` units. OpenCL runtimes can
+// only use such blocks in place for CL_MEM_USE_HOST_PTR buffers; with
+// arbitrary `new[]` memory they fall back to a hidden copy. Throws
+// std::bad_alloc on failure. Release with free_aligned().
+void* allocate_aligned(size_t bytes, size_t alignment);
+void free_aligned(void* block);
+
+struct HostArenaStats {
+    size_t  blocks;                     // mapped from the OS so far
+    size_t  reuses;                     // acquires served by a released block
+    size_t  bytes_mapped;               // currently mapped, in use or free
+    size_t  huge_page_advised_bytes;    // of bytes_mapped, from MAP_HUGETLB or accepted by
+                                        // MADV_HUGEPAGE, which is only a hint
+    double  first_touch_seconds;        // spent faulting in new blocks
+
+    HostArenaStats() : blocks(0), reuses(0), bytes_mapped(0), huge_page_advised_bytes(0), first_touch_seconds(0.0) {}
+};
+
+// Hands out blocks of host memory mapped straight from the OS, page-aligned
+// or better, for operand arrays. Every new block is faulted in by writing
+// one byte per page before it is returned, so the page-fault cost shows up
+// once in stats().first_touch_seconds instead of inside the first timed
+// run. Released blocks are kept and handed out again, so repetitions and
+// repeated runs don't map, fault or zero memory again. Thread-safe.
+//
+// With huge pages, blocks are rounded to 2 MiB and mapped with MAP_HUGETLB,
+// falling back to madvise(MADV_HUGEPAGE) (transparent huge pages) when no
+// huge pages are reserved. Neither is available everywhere; the fallback
+// is ordinary pages.
+class HostArena {
+protected:
+    struct Block {
+        void*   data;
+        size_t  size;
+        bool    huge;   // MAP_HUGETLB, or MADV_HUGEPAGE succeeded
+    };
+
+    mutable std::mutex              m_mutex;
+    bool                            m_huge_pages;
+    std::multimap<size_t, Block>    m_free;     // by size
+    std::map<void*, Block>          m_in_use;
+    HostArenaStats                  m_stats;
+
+    Block map_block(size_t size, size_t alignment, bool huge_pages) const;
+    void unmap_block(const Block& block) const;
+
+private:
+    HostArena(const HostArena&);
+    HostArena& operator=(const HostArena&);
+
+public:
+    explicit HostArena(bool huge_pages = false);
+    ~HostArena();
+
+    // Applies to blocks mapped from now on.
+    void set_huge_pages(bool huge_pages);
+
+    // A block of at least `bytes`, aligned to `alignment` (a power of two).
+    // Contents are unspecified: zero when new, old data when reused.
+    // Throws std::bad_alloc on failure.
+    void* acquire(size_t bytes, size_t alignment);
+    void release(void* block);
+
+    // Unmaps released blocks.
+    void trim();
+
+    HostArenaStats stats() const;
+};
+
+// The arena shared by the example's operand arrays.
+HostArena& host_arena();
+
+#endif // HOST_MEMORY_H__
@@ -0,0 +1,177 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "host_ops.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// Below this many elements per thread, waking the pool costs more than it
+// saves.
+static const size_t kMinElementsPerThread = 64 * 1024;
+
+void parallel_for(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body)
+{
+  if (end <= begin) {
+    return;
+  }
+  size_t count = end - begin;
+  ThreadPool& pool = host_thread_pool();
+  size_t blocks = std::min(pool.size(), std::max(count / kMinElementsPerThread, (size_t)1));
+  if (blocks == 1) {
+    body(begin, end);
+    return;
+  }
+
+  size_t block = (count + blocks - 1) / blocks;
+  pool.run(blocks, [&body, begin, end, block](size_t t) {
+    size_t block_begin = begin + t * block;
+    size_t block_end = std::min(end, block_begin + block);
+    if (block_begin < block_end) {
+      body(block_begin, block_end);
+    }
+  });
+}
+
+namespace {
+
+// Sums term(i) over [begin, end) in parallel. Partial sums are combined with
+// addition mod 2^64, which is associative, so the result doesn't depend on
+// how the range was blocked.
+template <typename Term>
+uint64_t parallel_sum(size_t begin, size_t end, Term term)
+{
+  std::vector<uint64_t> partials;
+  std::mutex partials_mutex;
+  parallel_for(begin, end, [&](size_t block_begin, size_t block_end) {
+    uint64_t sum = 0;
+    for (size_t i = block_begin; i < block_end; i++) {
+      sum += term(i);
+    }
+    std::lock_guard<std::mutex> lock(partials_mutex);
+    partials.push_back(sum);
+  });
+
+  uint64_t total = 0;
+  for (size_t i = 0; i < partials.size(); i++) {
+    total += partials[i];
+  }
+  return total;
+}
+
+} // namespace
+
+uint64_t fill_operands(int* a, int* b, size_t begin, size_t end)
+{
+  TraceScope scope("fill operands", "setup");
+  // Plain indexed stores with no dependencies, so the compiler vectorizes;
+  // the checksum comes from registers and costs no extra memory traffic.
+  return parallel_sum(begin, end, [a, b](size_t i) -> uint64_t {
+    a[i] = (int)i;
+    b[i] = (int)(2 * i);
+    return (uint32_t)((uint32_t)a[i] + (uint32_t)b[i]);
+  });
+}
+
+uint64_t expected_checksum(const int* a, const int* b, size_t N)
+{
+  return parallel_sum(0, N, [a, b](size_t i) -> uint64_t {
+    return (uint32_t)((uint32_t)a[i] + (uint32_t)b[i]);
+  });
+}
+
+uint64_t result_checksum(const int* c, size_t N)
+{
+  return parallel_sum(0, N, [c](size_t i) -> uint64_t {
+    return (uint32_t)c[i];
+  });
+}
+
+void validate_add(const int* c, const int* a, const int* b, size_t N)
+{
+  parallel_for(0, N, [c, a, b](size_t block_begin, size_t block_end) {
+    // Accumulate mismatches without branching so the loop vectorizes, and
+    // only report once per block.
+    unsigned int mismatches = 0;
+    for (size_t i = block_begin; i < block_end; i++) {
+      mismatches |= (unsigned int)c[i] ^ ((unsigned int)a[i] + (unsigned int)b[i]);
+    }
+    if (mismatches) {
+      throw std::runtime_error("Result validation failed");
+    }
+  });
+}
+
+void validate_add_sampled(const int* c, const int* a, const int* b, size_t N,
+                          uint64_t checksum, size_t samples, uint64_t seed)
+{
+  if (result_checksum(c, N) != checksum) {
+    throw std::runtime_error("Result validation failed: checksum mismatch");
+  }
+  if (N == 0) {
+    return;
+  }
+
+  std::vector<size_t> indices = sample_indices(N, samples, seed);
+  for (size_t s = 0; s < indices.size(); s++) {
+    size_t i = indices[s];
+    if ((unsigned int)c[i] != (unsigned int)a[i] + (unsigned int)b[i]) {
+      throw std::runtime_error("Result validation failed: sampled element mismatch");
+    }
+  }
+}
+
+std::vector<size_t> sample_indices(size_t N, size_t samples, uint64_t seed)
+{
+  std::vector<size_t> indices;
+  if (N == 0) {
+    return indices;
+  }
+  std::mt19937_64 generator(seed);
+  std::uniform_int_distribution<size_t> index(0, N - 1);
+  indices.reserve(samples);
+  for (size_t s = 0; s < samples; s++) {
+    indices.push_back(index(generator));
+  }
+  return indices;
+}
+
+void validate_add(const int* c, const int* a, const int* b, size_t N,
+                  uint64_t checksum, const ValidationOptions& options)
+{
+  TraceScope scope("validate", "validation");
+  if (options.mode == VALIDATE_FULL) {
+    validate_add(c, a, b, N);
+  } else if (options.mode == VALIDATE_SAMPLED) {
+    validate_add_sampled(c, a, b, N, checksum, options.samples);
+  }
+}
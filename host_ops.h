@@ -0,0 +1,85 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef HOST_OPS_H__
+#define HOST_OPS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+// Splits [begin, end) into one contiguous block per host_thread_pool() thread
+// and runs `body(block_begin, block_end)` on each, returning when all are
+// done. Small ranges run on the calling thread.
+void parallel_for(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body);
+
+// Order-independent checksum of the wrapped 32-bit sums a[i] + b[i]; for a
+// correct result it equals result_checksum(c, N). Checksums of disjoint
+// ranges add up to the checksum of their union.
+uint64_t expected_checksum(const int* a, const int* b, size_t N);
+uint64_t result_checksum(const int* c, size_t N);
+
+// Fills a[i] = i and b[i] = 2 * i for i in [begin, end), in parallel, and
+// returns the expected_checksum() of that range as a by-product.
+uint64_t fill_operands(int* a, int* b, size_t begin, size_t end);
+
+// Checks every element of c against a + b, in parallel. Throws
+// std::runtime_error on the first block with a mismatch.
+void validate_add(const int* c, const int* a, const int* b, size_t N);
+
+// Cheaper check for production runs: compares result_checksum(c) with
+// `checksum` (from fill_operands() or expected_checksum(), computed when the
+// operands are produced), then checks `samples` elements picked at random.
+// Reads c once and touches only the sampled elements of a and b.
+void validate_add_sampled(const int* c, const int* a, const int* b, size_t N,
+                          uint64_t checksum, size_t samples, uint64_t seed = 1);
+
+// The `samples` indices in [0, N) that validate_add_sampled() checks for
+// `seed`, for sampled checks of results that have no checksum. Empty if N
+// is 0.
+std::vector<size_t> sample_indices(size_t N, size_t samples, uint64_t seed = 1);
+
+enum ValidationMode {
+    VALIDATE_FULL,      // validate_add()
+    VALIDATE_SAMPLED,   // validate_add_sampled()
+    VALIDATE_NONE
+};
+
+struct ValidationOptions {
+    ValidationMode  mode;
+    size_t          samples;    // for VALIDATE_SAMPLED
+
+    ValidationOptions() : mode(VALIDATE_FULL), samples(4096) {}
+};
+
+// Runs the check `options` selects; `checksum` is only used by
+// VALIDATE_SAMPLED.
+void validate_add(const int* c, const int* a, const int* b, size_t N,
+                  uint64_t checksum, const ValidationOptions& options);
+
+#endif // HOST_OPS_H__
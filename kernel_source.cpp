@@ -0,0 +1,89 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "kernel_source.h"
+
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+
+// Generated by `xxd -i`; each defines an unsigned char array named after
+// the file and its length.
+#include "opencl_example_cl.h"
+#include "opencl_typed_cl.h"
+
+namespace {
+
+struct EmbeddedSource {
+    const char*             name;
+    const unsigned char*    data;
+    unsigned int            size;
+};
+
+const EmbeddedSource kEmbeddedSources[] = {
+  { "opencl_example.cl", opencl_example_cl, opencl_example_cl_len },
+  { "opencl_typed.cl", opencl_typed_cl, opencl_typed_cl_len },
+};
+
+std::mutex g_directory_mutex;
+std::string g_directory;
+
+} // namespace
+
+void set_kernel_source_directory(const std::string& directory)
+{
+  std::lock_guard<std::mutex> lock(g_directory_mutex);
+  g_directory = directory;
+}
+
+std::string kernel_source_directory()
+{
+  std::lock_guard<std::mutex> lock(g_directory_mutex);
+  return g_directory;
+}
+
+std::string kernel_source(const std::string& name)
+{
+  std::string directory = kernel_source_directory();
+  if (!directory.empty()) {
+    std::string path = directory + "/" + name;
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (source.empty()) {
+      throw std::runtime_error("kernel_source: cannot read " + path);
+    }
+    return source;
+  }
+
+  for (size_t i = 0; i < sizeof(kEmbeddedSources) / sizeof(kEmbeddedSources[0]); i++) {
+    if (name == kEmbeddedSources[i].name) {
+      return std::string((const char*)kEmbeddedSources[i].data, kEmbeddedSources[i].size);
+    }
+  }
+  throw std::invalid_argument("kernel_source: no embedded source for " + name);
+}
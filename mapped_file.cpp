@@ -0,0 +1,151 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdexcept>
+
+MappedFile::MappedFile()
+: m_fd(-1)
+, m_data(NULL)
+, m_size(0)
+, m_writable(false)
+{
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+: m_fd(other.m_fd)
+, m_data(other.m_data)
+, m_size(other.m_size)
+, m_writable(other.m_writable)
+{
+  other.m_fd = -1;
+  other.m_data = NULL;
+  other.m_size = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+  if (this != &other) {
+    release();
+    m_fd = other.m_fd;
+    m_data = other.m_data;
+    m_size = other.m_size;
+    m_writable = other.m_writable;
+    other.m_fd = -1;
+    other.m_data = NULL;
+    other.m_size = 0;
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile()
+{
+  release();
+}
+
+void MappedFile::release()
+{
+  if (m_data) {
+    munmap(m_data, m_size);
+    m_data = NULL;
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+  m_size = 0;
+}
+
+MappedFile MappedFile::open_read(const std::string& path)
+{
+  MappedFile file;
+  file.m_fd = ::open(path.c_str(), O_RDONLY);
+  if (file.m_fd < 0) {
+    throw std::runtime_error("open: " + path);
+  }
+  struct stat info;
+  if (fstat(file.m_fd, &info) != 0) {
+    throw std::runtime_error("fstat: " + path);
+  }
+  file.m_size = (size_t)info.st_size;
+
+  // mmap rejects zero-length mappings; an empty file maps to nothing.
+  if (file.m_size > 0) {
+    void* data = mmap(NULL, file.m_size, PROT_READ, MAP_SHARED, file.m_fd, 0);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("mmap: " + path);
+    }
+    file.m_data = data;
+    madvise(file.m_data, file.m_size, MADV_SEQUENTIAL);
+  }
+  return file;
+}
+
+bool MappedFile::is_file(const std::string& path) const
+{
+  struct stat mapped;
+  struct stat named;
+  if (m_fd < 0 || fstat(m_fd, &mapped) != 0 || stat(path.c_str(), &named) != 0) {
+    return false;
+  }
+  return mapped.st_dev == named.st_dev && mapped.st_ino == named.st_ino;
+}
+
+MappedFile MappedFile::create(const std::string& path, size_t size)
+{
+  MappedFile file;
+  file.m_writable = true;
+  file.m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file.m_fd < 0) {
+    throw std::runtime_error("open: " + path);
+  }
+  if (ftruncate(file.m_fd, (off_t)size) != 0) {
+    throw std::runtime_error("ftruncate: " + path);
+  }
+  file.m_size = size;
+
+  if (size > 0) {
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.m_fd, 0);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("mmap: " + path);
+    }
+    file.m_data = data;
+  }
+  return file;
+}
+
+void MappedFile::flush()
+{
+  if (m_writable && m_data && msync(m_data, m_size, MS_SYNC) != 0) {
+    throw std::runtime_error("msync");
+  }
+}
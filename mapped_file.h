@@ -0,0 +1,74 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef MAPPED_FILE_H__
+#define MAPPED_FILE_H__
+
+#include <stddef.h>
+#include <string>
+
+// A file mapped into memory with mmap. The mapping is page-aligned, so it
+// meets OpenCLEngine::host_alignment() on devices whose base address
+// alignment is no stricter than a page and can back CL_MEM_USE_HOST_PTR
+// buffers directly. Move-only; unmaps and closes on destruction.
+class MappedFile {
+protected:
+    int     m_fd;
+    void*   m_data;
+    size_t  m_size;
+    bool    m_writable;
+
+    void release();
+
+public:
+    MappedFile();
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps an existing file read-only, hinting sequential access.
+    static MappedFile open_read(const std::string& path);
+
+    // Creates (or truncates) a file of `size` bytes and maps it read-write.
+    static MappedFile create(const std::string& path, size_t size);
+
+    // True if `path` names the file this maps (same device and inode), e.g.
+    // so an output isn't created over a mapped input. False if `path`
+    // doesn't exist.
+    bool is_file(const std::string& path) const;
+
+    void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // Writes dirty pages of a writable mapping back to the file and waits.
+    void flush();
+};
+
+#endif // MAPPED_FILE_H__
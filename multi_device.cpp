@@ -0,0 +1,170 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "multi_device.h"
+#include "opencl_engine.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+// Weight of the newest measurement when refining throughput estimates.
+static const double kThroughputSmoothing = 0.5;
+
+MultiDeviceAdd::MultiDeviceAdd(const std::vector<cl_device_id>& devices, const std::string& cache_dir)
+: m_granule(1)
+{
+  try {
+    for (size_t i = 0; i < devices.size(); i++) {
+      m_engines.push_back(new OpenCLEngine(devices[i], cache_dir));
+      m_throughput.push_back(1.0);
+      m_granule = std::max(m_granule, m_engines.back()->local_size());
+    }
+  } catch (...) {
+    release();
+    throw;
+  }
+}
+
+MultiDeviceAdd::~MultiDeviceAdd()
+{
+  release();
+}
+
+void MultiDeviceAdd::release()
+{
+  for (size_t i = 0; i < m_engines.size(); i++) {
+    delete m_engines[i];
+  }
+  m_engines.clear();
+}
+
+void MultiDeviceAdd::calibrate(size_t N)
+{
+  N = std::max(N / m_granule, (size_t)1) * m_granule;
+  std::vector<int> a(N, 1);
+  std::vector<int> b(N, 2);
+  std::vector<int> c(N);
+
+  for (size_t i = 0; i < m_engines.size(); i++) {
+    // The first run pays for buffer allocation; time the second.
+    m_engines[i]->add_async(&c[0], &a[0], &b[0], N).wait();
+
+    Timer timer;
+    timer.start();
+    m_engines[i]->add_async(&c[0], &a[0], &b[0], N).wait();
+    timer.stop();
+    m_throughput[i] = timer.elapsed() > 0.0 ? N / timer.elapsed() : 1.0;
+  }
+}
+
+MultiDeviceResult MultiDeviceAdd::add(int* c, const int* a, const int* b, size_t N)
+{
+  double total_throughput = 0.0;
+  for (size_t i = 0; i < m_throughput.size(); i++) {
+    total_throughput += m_throughput[i];
+  }
+
+  // Split the range in proportion to throughput, in whole granules. The last
+  // device takes whatever is left.
+  MultiDeviceResult result;
+  size_t begin = 0;
+  for (size_t i = 0; i < m_engines.size(); i++) {
+    size_t count = N - begin;
+    if (i + 1 < m_engines.size()) {
+      size_t share = (size_t)(N * (m_throughput[i] / total_throughput));
+      count = std::min(share / m_granule * m_granule, count);
+    }
+    DevicePartition partition = { begin, count, 0.0 };
+    result.partitions.push_back(partition);
+    begin += count;
+  }
+
+  Timer timer;
+  timer.start();
+
+  // Launch every partition before waiting on any of them.
+  std::vector<AddOperation> operations(m_engines.size());
+  for (size_t i = 0; i < m_engines.size(); i++) {
+    const DevicePartition& partition = result.partitions[i];
+    if (partition.count > 0) {
+      operations[i] = m_engines[i]->add_async(c + partition.begin, a + partition.begin, b + partition.begin, partition.count);
+    }
+  }
+
+  // One waiter per device blocks in clWaitForEvents, so each finish time
+  // is seen as it happens without spinning a core while the devices work.
+  std::vector<std::thread> waiters;
+  std::vector<std::exception_ptr> errors(operations.size());
+  for (size_t i = 0; i < operations.size(); i++) {
+    if (operations[i].pending()) {
+      waiters.push_back(std::thread([&, i]() {
+        try {
+          operations[i].wait();
+          result.partitions[i].seconds = timer.elapsed();
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      }));
+    }
+  }
+  for (size_t i = 0; i < waiters.size(); i++) {
+    waiters[i].join();
+  }
+  for (size_t i = 0; i < errors.size(); i++) {
+    if (errors[i]) {
+      std::rethrow_exception(errors[i]);
+    }
+  }
+  timer.stop();
+  result.seconds = timer.elapsed();
+
+  for (size_t i = 0; i < result.partitions.size(); i++) {
+    const DevicePartition& partition = result.partitions[i];
+    if (partition.count > 0 && partition.seconds > 0.0) {
+      double measured = partition.count / partition.seconds;
+      m_throughput[i] = kThroughputSmoothing * measured + (1.0 - kThroughputSmoothing) * m_throughput[i];
+    }
+  }
+  return result;
+}
+
+cl_device_id fastest_device(const std::vector<cl_device_id>& candidates, const std::string& cache_dir, size_t N)
+{
+  MultiDeviceAdd multi(candidates, cache_dir);
+  multi.calibrate(N);
+
+  size_t fastest = 0;
+  for (size_t i = 1; i < multi.size(); i++) {
+    if (multi.throughput(i) > multi.throughput(fastest)) {
+      fastest = i;
+    }
+  }
+  return candidates[fastest];
+}
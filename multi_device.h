@@ -0,0 +1,87 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef MULTI_DEVICE_H__
+#define MULTI_DEVICE_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <OpenCL/opencl.h>
+
+class OpenCLEngine;
+
+struct DevicePartition {
+    size_t  begin;
+    size_t  count;
+    double  seconds;    // from launch until this device's results were back
+};
+
+struct MultiDeviceResult {
+    double                          seconds;
+    std::vector<DevicePartition>    partitions;     // one per device
+};
+
+// Splits one add across several devices, each with its own engine (and so its
+// own context and queue, since devices may sit on different platforms). The
+// range is divided in proportion to each device's measured throughput, and
+// all partitions run concurrently.
+class MultiDeviceAdd {
+protected:
+    std::vector<OpenCLEngine*>  m_engines;
+    std::vector<double>         m_throughput;   // elements per second
+    size_t                      m_granule;      // partitions are multiples of this
+
+    void release();
+
+private:
+    MultiDeviceAdd(const MultiDeviceAdd&);
+    MultiDeviceAdd& operator=(const MultiDeviceAdd&);
+
+public:
+    MultiDeviceAdd(const std::vector<cl_device_id>& devices, const std::string& cache_dir);
+    ~MultiDeviceAdd();
+
+    size_t size() const { return m_engines.size(); }
+    OpenCLEngine& engine(size_t i) { return *m_engines[i]; }
+    double throughput(size_t i) const { return m_throughput[i]; }
+
+    // Times an N-element add, transfers included, on each device in turn and
+    // uses the results as the initial split.
+    void calibrate(size_t N);
+
+    // Computes c = a + b with the range split across all devices. Each run
+    // also refines the throughput estimates, so the split tracks the devices'
+    // actual speed over time.
+    MultiDeviceResult add(int* c, const int* a, const int* b, size_t N);
+};
+
+// Calibrates an N-element add on each of `candidates` and returns the one
+// with the highest throughput, transfers included.
+cl_device_id fastest_device(const std::vector<cl_device_id>& candidates, const std::string& cache_dir, size_t N);
+
+#endif // MULTI_DEVICE_H__
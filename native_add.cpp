@@ -0,0 +1,142 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "native_add.h"
+#include "host_ops.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define NATIVE_ADD_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define NATIVE_ADD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+typedef void (*AddBlock)(int* c, const int* a, const int* b, size_t n);
+
+// Unsigned arithmetic so overflow wraps like the kernel instead of being
+// undefined.
+inline void add_tail(int* c, const int* a, const int* b, size_t i, size_t n)
+{
+  for (; i < n; i++) {
+    c[i] = (int)((uint32_t)a[i] + (uint32_t)b[i]);
+  }
+}
+
+void add_block_scalar(int* c, const int* a, const int* b, size_t n)
+{
+  add_tail(c, a, b, 0, n);
+}
+
+#if NATIVE_ADD_X86
+
+__attribute__((target("avx2")))
+void add_block_avx2(int* c, const int* a, const int* b, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+    _mm256_storeu_si256((__m256i*)(c + i), _mm256_add_epi32(va, vb));
+  }
+  add_tail(c, a, b, i, n);
+}
+
+__attribute__((target("avx512f")))
+void add_block_avx512(int* c, const int* a, const int* b, size_t n)
+{
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i va = _mm512_loadu_si512((const void*)(a + i));
+    __m512i vb = _mm512_loadu_si512((const void*)(b + i));
+    _mm512_storeu_si512((void*)(c + i), _mm512_add_epi32(va, vb));
+  }
+  add_tail(c, a, b, i, n);
+}
+
+#elif NATIVE_ADD_NEON
+
+void add_block_neon(int* c, const int* a, const int* b, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    vst1q_s32(c + i, vaddq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+  }
+  add_tail(c, a, b, i, n);
+}
+
+#endif
+
+struct NativeKernel {
+    const char* isa;
+    AddBlock    block;
+};
+
+NativeKernel select_kernel()
+{
+#if NATIVE_ADD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    NativeKernel kernel = { "AVX-512", add_block_avx512 };
+    return kernel;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    NativeKernel kernel = { "AVX2", add_block_avx2 };
+    return kernel;
+  }
+#elif NATIVE_ADD_NEON
+  NativeKernel kernel = { "NEON", add_block_neon };
+  return kernel;
+#endif
+  NativeKernel scalar = { "scalar", add_block_scalar };
+  return scalar;
+}
+
+const NativeKernel& native_kernel()
+{
+  static const NativeKernel kernel = select_kernel();
+  return kernel;
+}
+
+} // namespace
+
+const char* native_add_isa()
+{
+  return native_kernel().isa;
+}
+
+void native_add(int* c, const int* a, const int* b, size_t N)
+{
+  AddBlock block = native_kernel().block;
+  parallel_for(0, N, [c, a, b, block](size_t block_begin, size_t block_end) {
+    block(c + block_begin, a + block_begin, b + block_begin, block_end - block_begin);
+  });
+}
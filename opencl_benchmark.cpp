@@ -0,0 +1,298 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+/*
+  Regression suite for the add paths of opencl_example. Built with:
+  
+    xxd -i opencl_example.cl > opencl_example_cl.h
+    xxd -i opencl_typed.cl > opencl_typed_cl.h
+    g++ -std=c++11 opencl_benchmark.cpp benchmark.cpp buffer_pool.cpp cl_handle.cpp devices.cpp host_memory.cpp host_ops.cpp kernel_source.cpp multi_device.cpp native_add.cpp opencl_engine.cpp program_cache.cpp regression.cpp stream_add.cpp thread_pool.cpp timer.cpp trace.cpp typed_add.cpp -o opencl_benchmark -framework OpenCL
+    
+  Every selected device runs the scalar, vectorized and coarsened kernels,
+  zero-copy, streaming and the typed kernel over each element type, at
+  each size; with several devices the multi-device split runs as well.
+  --results saves one file per device (or device set), and --baseline
+  compares against files saved earlier and flags every case that got
+  significantly slower (Welch's t-test at --alpha, and by at least
+  --threshold percent). The exit status is 1 if anything regressed.
+  
+  Run with:
+  
+    ./opencl_benchmark --devices all --results baselines
+    ./opencl_benchmark --devices all --baseline baselines
+    ./opencl_benchmark --use-gpu --baseline baselines --results baselines
+    ./opencl_benchmark --use-gpu --sizes 1048576,67108864 --types int,float,half
+    ./opencl_benchmark --use-cpu --repetitions 30 --alpha 0.001 --threshold 10 --baseline baselines
+*/
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "devices.h"
+#include "kernel_source.h"
+#include "multi_device.h"
+#include "opencl_engine.h"
+#include "regression.h"
+
+enum {
+  OPT_SIZES = 256,
+  OPT_TYPES,
+  OPT_WARMUP,
+  OPT_REPETITIONS,
+  OPT_VALIDATION,
+  OPT_BASELINE,
+  OPT_RESULTS,
+  OPT_ALPHA,
+  OPT_THRESHOLD,
+  OPT_KERNEL_SOURCE
+};
+
+std::vector<std::string> split_list(const std::string& list)
+{
+  std::vector<std::string> items;
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    if (end > begin) {
+      items.push_back(list.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  return items;
+}
+
+// The sizes that fit the engine's device, see benchmark_sweep_sizes().
+std::vector<size_t> fitting_sizes(const OpenCLEngine& engine, const std::vector<size_t>& sizes)
+{
+  std::vector<size_t> sweep = benchmark_sweep_sizes(engine);
+  size_t limit = sweep.empty() ? 0 : sweep.back();
+  std::vector<size_t> fitting;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    if (sizes[i] <= limit) {
+      fitting.push_back(sizes[i]);
+    }
+  }
+  return fitting;
+}
+
+// Prints one device's results against its baseline, if there is one, and
+// saves them to `results_dir`. Returns the number of regressions.
+size_t report_suite(const std::string& device, const std::string& driver, const std::vector<SuiteResult>& results,
+                    const std::string& baseline_dir, const std::string& results_dir,
+                    const RegressionOptions& options)
+{
+  std::vector<CaseComparison> comparisons;
+  if (!baseline_dir.empty()) {
+    std::string path = baseline_file_path(baseline_dir, device);
+    Baseline baseline;
+    if (load_baseline(path, &baseline)) {
+      comparisons = compare_to_baseline(results, baseline, options);
+      if (baseline.driver != driver) {
+        std::cout << "Baseline is from driver " << baseline.driver << ", now " << driver << std::endl;
+      }
+    } else {
+      std::cout << "No baseline for " << device << " in " << path << std::endl;
+    }
+  }
+  
+  write_suite(std::cout, device, results, comparisons);
+  size_t regressions = count_regressions(comparisons);
+  if (regressions) {
+    std::cout << regressions << " significant slowdowns against the baseline" << std::endl;
+  }
+  
+  if (!results_dir.empty()) {
+    std::string path = baseline_file_path(results_dir, device);
+    if (!save_baseline(path, device, driver, results)) {
+      throw std::runtime_error("Could not write " + path);
+    }
+    std::cout << "Results saved to " << path << std::endl;
+  }
+  return regressions;
+}
+
+int main(int argc, char** argv)
+{
+  int o = 0;
+  std::string device_selection = "all";
+  std::string cache_dir = ".opencl_cache";
+  std::vector<size_t> sizes;
+  std::vector<std::string> types = suite_types();
+  BenchmarkConfig config;
+  RegressionOptions regression;
+  std::string baseline_dir;
+  std::string results_dir;
+  
+  sizes.push_back(64 * 1024);
+  sizes.push_back(1024 * 1024);
+  sizes.push_back(16 * 1024 * 1024);
+  
+  struct option longopts[] = {
+    { "use-cpu", no_argument, 0, 'c' },
+    { "use-gpu", no_argument, 0, 'g' },
+    { "devices", required_argument, 0, 'x' },
+    { "cache-dir", required_argument, 0, 'd' },
+    { "no-cache", no_argument, 0, 'D' },
+    { "sizes", required_argument, 0, OPT_SIZES },
+    { "types", required_argument, 0, OPT_TYPES },
+    { "warmup", required_argument, 0, OPT_WARMUP },
+    { "repetitions", required_argument, 0, OPT_REPETITIONS },
+    { "validation", required_argument, 0, OPT_VALIDATION },
+    { "baseline", required_argument, 0, OPT_BASELINE },
+    { "results", required_argument, 0, OPT_RESULTS },
+    { "alpha", required_argument, 0, OPT_ALPHA },
+    { "threshold", required_argument, 0, OPT_THRESHOLD },
+    { "kernel-source", required_argument, 0, OPT_KERNEL_SOURCE },
+    { 0, 0, 0, 0 },
+  };
+  
+  while((o = getopt_long(argc, argv, "cgx:d:D", longopts, 0)) != -1) {
+    switch(o) {
+      case 'c':
+        device_selection = "cpu:0";
+        break;
+      case 'g':
+        device_selection = "gpu:0";
+        break;
+      case 'x':
+        device_selection = optarg;
+        break;
+      case 'd':
+        cache_dir = optarg;
+        break;
+      case 'D':
+        cache_dir.clear();
+        break;
+      case OPT_SIZES: {
+        std::vector<std::string> items = split_list(optarg);
+        sizes.clear();
+        for (size_t i = 0; i < items.size(); i++) {
+          sizes.push_back(strtoull(items[i].c_str(), NULL, 0));
+        }
+        break;
+      }
+      case OPT_TYPES:
+        types = split_list(optarg);
+        break;
+      case OPT_WARMUP:
+        config.warmup = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_REPETITIONS:
+        config.repetitions = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_VALIDATION:
+        if (std::string(optarg) == "full") {
+          config.validation.mode = VALIDATE_FULL;
+        } else if (std::string(optarg) == "sampled") {
+          config.validation.mode = VALIDATE_SAMPLED;
+        } else if (std::string(optarg) == "none") {
+          config.validation.mode = VALIDATE_NONE;
+        } else {
+          throw std::invalid_argument("--validation must be full, sampled or none");
+        }
+        break;
+      case OPT_BASELINE:
+        baseline_dir = optarg;
+        break;
+      case OPT_RESULTS:
+        results_dir = optarg;
+        break;
+      case OPT_ALPHA:
+        regression.alpha = strtod(optarg, NULL);
+        break;
+      case OPT_THRESHOLD:
+        // Percent on the command line.
+        regression.min_change = strtod(optarg, NULL) * 1e-2;
+        break;
+      case OPT_KERNEL_SOURCE:
+        set_kernel_source_directory(optarg);
+        break;
+      default:
+        break;
+    }
+  }
+  
+  // The t-test needs at least two samples on each side.
+  if (config.repetitions < 2) {
+    throw std::invalid_argument("--repetitions must be at least 2");
+  }
+  if (sizes.empty() || std::find(sizes.begin(), sizes.end(), (size_t)0) != sizes.end()) {
+    throw std::invalid_argument("--sizes must list non-zero element counts");
+  }
+  
+  std::vector<cl_device_id> devices = select_devices(device_selection);
+  size_t regressions = 0;
+  size_t multi_limit = *std::max_element(sizes.begin(), sizes.end());
+  for (size_t d = 0; d < devices.size(); d++) {
+    OpenCLEngine engine(devices[d], cache_dir);
+    config.sizes = fitting_sizes(engine, sizes);
+    if (config.sizes.empty()) {
+      std::cout << "No size fits " << device_name(devices[d]) << std::endl;
+      multi_limit = 0;
+      continue;
+    }
+    multi_limit = std::min(multi_limit, *std::max_element(config.sizes.begin(), config.sizes.end()));
+    
+    std::vector<SuiteResult> results = run_suite(engine, config, types);
+    regressions += report_suite(device_key(devices[d]), device_string(devices[d], CL_DRIVER_VERSION), results,
+                                baseline_dir, results_dir, regression);
+  }
+  
+  // The device set, not each device, is what the multi-device results are
+  // stored under; the keys keep "A + A" apart from "A + B" even when two
+  // devices share a name. Only sizes every device fits are run.
+  if (devices.size() > 1) {
+    config.sizes.clear();
+    for (size_t i = 0; i < sizes.size(); i++) {
+      if (sizes[i] <= multi_limit) {
+        config.sizes.push_back(sizes[i]);
+      }
+    }
+    if (!config.sizes.empty()) {
+      std::string name;
+      std::string driver;
+      for (size_t d = 0; d < devices.size(); d++) {
+        name += (d ? " + " : "") + device_key(devices[d]);
+        driver += (d ? " + " : "") + device_string(devices[d], CL_DRIVER_VERSION);
+      }
+      MultiDeviceAdd multi(devices, cache_dir);
+      multi.calibrate(std::min(config.sizes.back(), (size_t)4 * 1024 * 1024));
+      std::vector<SuiteResult> results = run_multi_device_suite(multi, config);
+      regressions += report_suite(name, driver, results, baseline_dir, results_dir, regression);
+    }
+  }
+  
+  return regressions ? 1 : 0;
+}
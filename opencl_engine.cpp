@@ -0,0 +1,670 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "opencl_engine.h"
+#include "cl_handle.h"
+#include "devices.h"
+#include "host_memory.h"
+#include "kernel_source.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// Work groups launched per compute unit by the coarsened kernel, so that each
+// unit has other groups to switch to while one waits on memory.
+static const size_t kWorkGroupsPerComputeUnit = 4;
+
+OpenCLEngine::OpenCLEngine(cl_device_id device, const std::string& cache_dir, bool out_of_order)
+: m_device(device)
+, m_cache(cache_dir)
+, m_add_kernel(ADD_SCALAR)
+, m_out_of_order(out_of_order && supports_out_of_order(device))
+, m_fp64(false)
+, m_local_size(0)
+, m_compute_units(1)
+, m_elements_per_item(4)
+, m_host_alignment(host_page_size())
+{
+  for (size_t i = 0; i < ADD_KERNEL_COUNT; i++) {
+    m_max_local_sizes[i] = 0;
+  }
+
+  // Every OpenCL object is held by a handle, so a failure anywhere below
+  // releases whatever was created before it.
+  TraceScope scope("engine setup", "setup");
+
+  // Create a context on the device's own platform; with several ICDs
+  // installed there is no sensible default platform.
+  cl_platform_id platform = NULL;
+  cl_int err = clGetDeviceInfo(m_device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clGetDeviceInfo", err);
+  }
+
+  cl_context_properties properties[] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+  m_context.reset(clCreateContext(properties, 1, &m_device, NULL, NULL, &err));
+  if (!m_context.get()) {
+    throw OpenCLError("clCreateContext", err);
+  }
+
+  // Create a command queue. Profiling costs next to nothing and gives
+  // device-side timestamps for every command.
+  cl_command_queue_properties queue_properties = CL_QUEUE_PROFILING_ENABLE;
+  if (m_out_of_order) {
+    queue_properties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+  }
+  m_queue.reset(clCreateCommandQueue(m_context.get(), m_device, queue_properties, &err));
+  if (!m_queue.get()) {
+    throw OpenCLError("clCreateCommandQueue", err);
+  }
+
+  // The source is embedded in the executable unless overridden.
+  m_source = kernel_source("opencl_example.cl");
+
+  build_program();
+
+  err = clGetDeviceInfo(m_device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(m_compute_units), &m_compute_units, NULL);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clGetDeviceInfo", err);
+  }
+
+  cl_uint preferred_vector_width = 1;
+  err = clGetDeviceInfo(m_device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT, sizeof(preferred_vector_width), &preferred_vector_width, NULL);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clGetDeviceInfo", err);
+  }
+  set_add_kernel(preferred_add_kernel(preferred_vector_width));
+
+  // CL_DEVICE_MEM_BASE_ADDR_ALIGN is reported in bits.
+  cl_uint base_align_bits = 0;
+  err = clGetDeviceInfo(m_device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(base_align_bits), &base_align_bits, NULL);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clGetDeviceInfo", err);
+  }
+  if (base_align_bits / 8 > m_host_alignment) {
+    m_host_alignment = base_align_bits / 8;
+  }
+
+  cl_device_fp_config fp64 = 0;
+  err = clGetDeviceInfo(m_device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp64), &fp64, NULL);
+  m_fp64 = (err == CL_SUCCESS && fp64 != 0) ||
+           device_string(m_device, CL_DEVICE_EXTENSIONS).find("cl_khr_fp64") != std::string::npos;
+
+  m_pool.reset(new BufferPool(m_context.get()));
+}
+
+void OpenCLEngine::build_program()
+{
+  TraceScope scope("build program", "build");
+
+  // Build the program, or load a previously built binary from the cache.
+  // The engine's current program and kernels are only replaced once the
+  // new ones are complete.
+  std::string options = "-DELEMENTS_PER_ITEM=" + std::to_string(m_elements_per_item);
+  ProgramHandle program(m_cache.build(m_context.get(), m_device, m_source, options, &m_build_info));
+
+  // Extract the compute kernels from the program, and get the maximum work
+  // group size for each on the device we're using.
+  KernelHandle kernels[ADD_KERNEL_COUNT];
+  size_t max_local_sizes[ADD_KERNEL_COUNT];
+  for (size_t i = 0; i < ADD_KERNEL_COUNT; i++) {
+    cl_int err = CL_SUCCESS;
+    kernels[i].reset(clCreateKernel(program.get(), add_kernel_name((AddKernel)i), &err));
+    if (!kernels[i] || err != CL_SUCCESS) {
+      throw OpenCLError("clCreateKernel", err);
+    }
+
+    err = clGetKernelWorkGroupInfo(kernels[i].get(), m_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_local_sizes[i]), &max_local_sizes[i], NULL);
+    if (err != CL_SUCCESS) {
+      throw OpenCLError("clGetKernelWorkGroupInfo", err);
+    }
+  }
+
+  for (size_t i = 0; i < ADD_KERNEL_COUNT; i++) {
+    m_kernels[i] = std::move(kernels[i]);
+    m_max_local_sizes[i] = max_local_sizes[i];
+  }
+  m_program = std::move(program);
+}
+
+namespace {
+
+// Trace spans for the four commands of an add.
+void trace_add_events(cl_event write_a, cl_event write_b, cl_event kernel, cl_event read)
+{
+  trace().device_span("write a", "transfer", write_a);
+  trace().device_span("write b", "transfer", write_b);
+  trace().device_span("kernel", "kernel", kernel);
+  trace().device_span("read c", "transfer", read);
+}
+
+cl_ulong profiling_value(cl_event event, cl_profiling_info param)
+{
+  cl_ulong value = 0;
+  check_cl(clGetEventProfilingInfo(event, param, sizeof(value), &value, NULL), "clGetEventProfilingInfo");
+  return value;
+}
+
+} // namespace
+
+StageTiming stage_timing(cl_event event)
+{
+  StageTiming timing;
+  timing.queued = profiling_value(event, CL_PROFILING_COMMAND_QUEUED);
+  timing.submit = profiling_value(event, CL_PROFILING_COMMAND_SUBMIT);
+  timing.start = profiling_value(event, CL_PROFILING_COMMAND_START);
+  timing.end = profiling_value(event, CL_PROFILING_COMMAND_END);
+  return timing;
+}
+
+const char* add_kernel_name(AddKernel kernel)
+{
+  static const char* names[ADD_KERNEL_COUNT] = { "add", "add_int4", "add_int8", "add_int16", "add_coarse" };
+  return names[kernel];
+}
+
+size_t add_kernel_width(AddKernel kernel)
+{
+  static const size_t widths[ADD_KERNEL_COUNT] = { 1, 4, 8, 16, 1 };
+  return widths[kernel];
+}
+
+AddKernel preferred_add_kernel(cl_uint preferred_vector_width)
+{
+  AddKernel best = ADD_SCALAR;
+  for (size_t i = ADD_SCALAR; i <= ADD_INT16; i++) {
+    if (add_kernel_width((AddKernel)i) <= preferred_vector_width) {
+      best = (AddKernel)i;
+    }
+  }
+  return best;
+}
+
+bool supports_out_of_order(cl_device_id device)
+{
+  cl_command_queue_properties properties = 0;
+  cl_int err = clGetDeviceInfo(device, CL_DEVICE_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL);
+  return err == CL_SUCCESS && (properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+}
+
+void OpenCLEngine::set_add_kernel(AddKernel kernel)
+{
+  m_add_kernel = kernel;
+  m_local_size = m_max_local_sizes[kernel];
+}
+
+void OpenCLEngine::set_local_size(size_t local_size)
+{
+  if (local_size == 0 || local_size > m_max_local_sizes[m_add_kernel]) {
+    throw std::invalid_argument("set_local_size: out of range for the current kernel");
+  }
+  m_local_size = local_size;
+}
+
+void OpenCLEngine::set_elements_per_item(unsigned int elements_per_item)
+{
+  if (elements_per_item == 0) {
+    throw std::invalid_argument("set_elements_per_item: must be non-zero");
+  }
+  if (elements_per_item != m_elements_per_item) {
+    m_elements_per_item = elements_per_item;
+    build_program();
+    set_add_kernel(m_add_kernel);
+  }
+}
+
+cl_command_queue OpenCLEngine::create_queue(cl_command_queue_properties properties)
+{
+  cl_int err = CL_SUCCESS;
+  cl_command_queue queue = clCreateCommandQueue(m_context.get(), m_device, properties, &err);
+  if (!queue) {
+    throw OpenCLError("clCreateCommandQueue", err);
+  }
+  return queue;
+}
+
+cl_kernel OpenCLEngine::create_add_kernel() const
+{
+  return create_kernel(add_kernel_name(m_add_kernel));
+}
+
+cl_kernel OpenCLEngine::create_kernel(const char* name) const
+{
+  cl_int err = CL_SUCCESS;
+  cl_kernel kernel = clCreateKernel(m_program.get(), name, &err);
+  if (!kernel || err != CL_SUCCESS) {
+    throw OpenCLError("clCreateKernel", err);
+  }
+  return kernel;
+}
+
+void OpenCLEngine::enqueue_add(cl_command_queue queue, cl_mem c, cl_mem a, cl_mem b, size_t N,
+                               cl_uint num_events, const cl_event* wait_list, cl_event* event)
+{
+  enqueue_add(m_kernels[m_add_kernel].get(), queue, c, a, b, N, num_events, wait_list, event);
+}
+
+void OpenCLEngine::enqueue_add(cl_kernel kernel, cl_command_queue queue, cl_mem c, cl_mem a, cl_mem b, size_t N,
+                               cl_uint num_events, const cl_event* wait_list, cl_event* event) const
+{
+  // The kernel indexes with 32-bit integers; larger arrays go through
+  // stream_add() in chunks.
+  if (N > CL_UINT_MAX) {
+    throw std::invalid_argument("enqueue_add: N exceeds 32-bit kernel indexing");
+  }
+  cl_uint n = (cl_uint)N;
+
+  // An empty NDRange is an error, but callers still expect an event that
+  // completes after the wait list.
+  if (N == 0) {
+    cl_int err = clEnqueueMarkerWithWaitList(queue, num_events, wait_list, event);
+    if (err != CL_SUCCESS) {
+      throw OpenCLError("clEnqueueMarkerWithWaitList", err);
+    }
+    return;
+  }
+
+  // Set the arguments to the kernel. They are captured at enqueue time, so
+  // the kernel can be reused for the next launch straight away.
+  cl_int err = CL_SUCCESS;
+  err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &c);
+  err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &a);
+  err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &b);
+  err |= clSetKernelArg(kernel, 3, sizeof(cl_uint), &n);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clSetKernelArg", err);
+  }
+
+  // Execute the kernel over the entire arrays using the maximum number
+  // of work group items (i.e., local_size) for this device. Vector kernels
+  // need one work-item per `width` elements, plus one for any tail. The
+  // global size is rounded up to a whole number of work groups so that any
+  // N works; the kernel skips the padding work-items.
+  size_t width = add_kernel_width(m_add_kernel);
+  size_t work_items = (N + width - 1) / width;
+  if (m_add_kernel == ADD_COARSE) {
+    // The coarsened kernel loops, so its global size follows the device
+    // rather than N: enough work groups to keep every compute unit busy,
+    // but no more than N needs at ELEMENTS_PER_ITEM per work-item.
+    size_t device_items = (size_t)m_compute_units * kWorkGroupsPerComputeUnit * m_local_size;
+    work_items = std::min(device_items, (N + m_elements_per_item - 1) / m_elements_per_item);
+  }
+  size_t global_size = (work_items + m_local_size - 1) / m_local_size * m_local_size;
+  err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, &m_local_size, num_events, wait_list, event);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueNDRangeKernel", err);
+  }
+}
+
+double OpenCLEngine::add(int* c, const int* a, const int* b, size_t N, AddProfile* profile)
+{
+  // Zero-byte writes and reads are errors.
+  if (N == 0) {
+    if (profile) {
+      *profile = AddProfile();
+    }
+    return 0.0;
+  }
+
+  // Check out device buffers for our kernel (two inputs, one output). After
+  // the first call these come from the pool without touching the driver.
+  // `finish` drains the queue before they go back, however add() exits.
+  PooledBuffer a_device(*m_pool, sizeof(int) * N, CL_MEM_READ_ONLY);
+  PooledBuffer b_device(*m_pool, sizeof(int) * N, CL_MEM_READ_ONLY);
+  PooledBuffer c_device(*m_pool, sizeof(int) * N, CL_MEM_WRITE_ONLY);
+  EventHandle write_a, write_b, kernel, read;
+  QueueFinish finish(m_queue.get());
+
+  // Write the input arrays into device memory.
+  cl_int err = clEnqueueWriteBuffer(m_queue.get(), a_device.get(), CL_TRUE, 0, sizeof(int) * N, a, 0, NULL, write_a.out());
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueWriteBuffer", err);
+  }
+
+  err = clEnqueueWriteBuffer(m_queue.get(), b_device.get(), CL_TRUE, 0, sizeof(int) * N, b, 0, NULL, write_b.out());
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueWriteBuffer", err);
+  }
+
+  enqueue_add(m_queue.get(), c_device.get(), a_device.get(), b_device.get(), N, 0, NULL, kernel.out());
+
+  // Wait for the command queue to get serviced before reading back results
+  clFinish(m_queue.get());
+
+  // Read the output array from device memory into host memory.
+  err = clEnqueueReadBuffer(m_queue.get(), c_device.get(), CL_TRUE, 0, sizeof(int) * N, c, 0, NULL, read.out());
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueReadBuffer", err);
+  }
+
+  AddProfile stages;
+  stages.write_a = stage_timing(write_a.get());
+  stages.write_b = stage_timing(write_b.get());
+  stages.kernel = stage_timing(kernel.get());
+  stages.read = stage_timing(read.get());
+  trace_add_events(write_a.get(), write_b.get(), kernel.get(), read.get());
+
+  if (profile) {
+    *profile = stages;
+  }
+  return stages.kernel.run_seconds();
+}
+
+double OpenCLEngine::add_zero_copy(int* c, const int* a, const int* b, size_t N, AddProfile* profile)
+{
+  // A zero-sized buffer is an error; there is nothing to do either.
+  if (N == 0) {
+    if (profile) {
+      *profile = AddProfile();
+    }
+    return 0.0;
+  }
+
+  // Wrap the host arrays in buffers. These are tied to the host pointers so
+  // they can't come from the pool.
+  cl_int err = CL_SUCCESS;
+  MemHandle a_device(clCreateBuffer(m_context.get(), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(int) * N, (void*)a, &err));
+  if (!a_device) {
+    throw OpenCLError("clCreateBuffer", err);
+  }
+  MemHandle b_device(clCreateBuffer(m_context.get(), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(int) * N, (void*)b, &err));
+  if (!b_device) {
+    throw OpenCLError("clCreateBuffer", err);
+  }
+  MemHandle c_device(clCreateBuffer(m_context.get(), CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, sizeof(int) * N, c, &err));
+  if (!c_device) {
+    throw OpenCLError("clCreateBuffer", err);
+  }
+
+  // Released buffers live on until the commands using them finish, so no
+  // clFinish is needed on the error paths.
+  EventHandle kernel, map;
+  enqueue_add(m_queue.get(), c_device.get(), a_device.get(), b_device.get(), N, 0, NULL, kernel.out());
+  clFinish(m_queue.get());
+
+  // Mapping the output makes the results visible at `c`. On zero-copy
+  // devices this is only a cache flush; elsewhere the runtime copies back.
+  void* mapped = clEnqueueMapBuffer(m_queue.get(), c_device.get(), CL_TRUE, CL_MAP_READ, 0, sizeof(int) * N, 0, NULL, map.out(), &err);
+  if (!mapped || err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueMapBuffer", err);
+  }
+  err = clEnqueueUnmapMemObject(m_queue.get(), c_device.get(), mapped, 0, NULL, NULL);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueUnmapMemObject", err);
+  }
+  clFinish(m_queue.get());
+
+  AddProfile stages;
+  stages.kernel = stage_timing(kernel.get());
+  stages.read = stage_timing(map.get());
+  trace().device_span("kernel", "kernel", kernel.get());
+  trace().device_span("map c", "transfer", map.get());
+
+  if (profile) {
+    *profile = stages;
+  }
+  return stages.kernel.run_seconds();
+}
+
+AddOperation::AddOperation()
+{
+}
+
+AddOperation::AddOperation(AddOperation&& other)
+{
+  *this = std::move(other);
+}
+
+AddOperation& AddOperation::operator=(AddOperation&& other)
+{
+  if (this != &other) {
+    if (pending()) {
+      try { wait(); } catch (...) {}
+    }
+    m_profile = other.m_profile;
+    for (size_t i = 0; i < 3; i++) m_buffers[i] = std::move(other.m_buffers[i]);
+    for (size_t i = 0; i < 4; i++) m_events[i] = std::move(other.m_events[i]);
+  }
+  return *this;
+}
+
+AddOperation::~AddOperation()
+{
+  if (pending()) {
+    try { wait(); } catch (...) {}
+  }
+}
+
+void AddOperation::reset()
+{
+  // The buffers can only go back to the pool once nothing on the device
+  // still refers to them, so wait on whatever was enqueued.
+  for (size_t i = 0; i < 4; i++) {
+    if (m_events[i]) {
+      cl_event event = m_events[i].get();
+      clWaitForEvents(1, &event);
+      m_events[i].reset();
+    }
+  }
+  for (size_t i = 0; i < 3; i++) {
+    m_buffers[i].reset();
+  }
+}
+
+bool AddOperation::ready() const
+{
+  if (!pending()) {
+    return true;
+  }
+  cl_int status = CL_COMPLETE;
+  cl_int err = clGetEventInfo(m_events[3].get(), CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+  return err != CL_SUCCESS || status <= CL_COMPLETE;
+}
+
+void AddOperation::wait()
+{
+  if (!pending()) {
+    return;
+  }
+
+  // A missing read event means enqueueing failed part way through.
+  cl_event read = m_events[3].get();
+  cl_int err = read ? clWaitForEvents(1, &read) : CL_INVALID_EVENT;
+  cl_int status = CL_COMPLETE;
+  if (err == CL_SUCCESS) {
+    err = clGetEventInfo(read, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+  }
+  if (err == CL_SUCCESS && status == CL_COMPLETE) {
+    // The read waited on the kernel, which waited on both writes, so every
+    // stage has finished and has its timestamps.
+    try {
+      m_profile.write_a = stage_timing(m_events[0].get());
+      m_profile.write_b = stage_timing(m_events[1].get());
+      m_profile.kernel = stage_timing(m_events[2].get());
+      m_profile.read = stage_timing(read);
+      trace_add_events(m_events[0].get(), m_events[1].get(), m_events[2].get(), read);
+    } catch (...) {
+      reset();
+      throw;
+    }
+  }
+  reset();
+
+  if (err != CL_SUCCESS || status != CL_COMPLETE) {
+    throw std::runtime_error("AddOperation::wait");
+  }
+}
+
+AddOperation OpenCLEngine::add_async(int* c, const int* a, const int* b, size_t N)
+{
+  // The operation owns the buffers and events from here on, so any failure
+  // below hands everything back when `op` goes out of scope.
+  AddOperation op;
+
+  // Zero-byte writes are errors; like add(), an empty add does nothing and
+  // the operation is never pending.
+  if (N == 0) {
+    return op;
+  }
+  cl_command_queue queue = m_queue.get();
+  op.m_buffers[0] = PooledBuffer(*m_pool, sizeof(int) * N, CL_MEM_READ_ONLY);
+  op.m_buffers[1] = PooledBuffer(*m_pool, sizeof(int) * N, CL_MEM_READ_ONLY);
+  op.m_buffers[2] = PooledBuffer(*m_pool, sizeof(int) * N, CL_MEM_WRITE_ONLY);
+
+  // Write the input arrays without blocking the host.
+  check_cl(clEnqueueWriteBuffer(queue, op.m_buffers[0].get(), CL_FALSE, 0, sizeof(int) * N, a, 0, NULL,
+                                op.m_events[0].out()), "clEnqueueWriteBuffer");
+  check_cl(clEnqueueWriteBuffer(queue, op.m_buffers[1].get(), CL_FALSE, 0, sizeof(int) * N, b, 0, NULL,
+                                op.m_events[1].out()), "clEnqueueWriteBuffer");
+
+  // The kernel depends on both writes, and the read-back on the kernel.
+  cl_event writes[2] = { op.m_events[0].get(), op.m_events[1].get() };
+  enqueue_add(queue, op.m_buffers[2].get(), op.m_buffers[0].get(), op.m_buffers[1].get(), N, 2, writes,
+              op.m_events[2].out());
+
+  cl_event kernel = op.m_events[2].get();
+  check_cl(clEnqueueReadBuffer(queue, op.m_buffers[2].get(), CL_FALSE, 0, sizeof(int) * N, c, 1, &kernel,
+                               op.m_events[3].out()), "clEnqueueReadBuffer");
+
+  // Make sure the work actually starts before the caller blocks elsewhere.
+  clFlush(queue);
+
+  return op;
+}
+
+const TypedKernel& OpenCLEngine::typed_kernel(const std::string& options)
+{
+  std::map<std::string, TypedKernel>::iterator found = m_typed_kernels.find(options);
+  if (found != m_typed_kernels.end()) {
+    return found->second;
+  }
+
+  if (options.find("-DUSE_FP64") != std::string::npos && !m_fp64) {
+    throw std::runtime_error("typed_kernel: device has no double precision support");
+  }
+
+  // Only loaded once a typed add is used, so the int-only paths never read
+  // an overridden file.
+  if (m_typed_source.empty()) {
+    m_typed_source = kernel_source("opencl_typed.cl");
+  }
+
+  TraceScope scope("build typed program", "build");
+  ProgramBuildInfo info;
+  ProgramHandle program(m_cache.build(m_context.get(), m_device, m_typed_source, options, &info));
+
+  cl_int err = CL_SUCCESS;
+  KernelHandle kernel(clCreateKernel(program.get(), "add_typed", &err));
+  if (!kernel || err != CL_SUCCESS) {
+    throw OpenCLError("clCreateKernel", err);
+  }
+  size_t max_local_size = 0;
+  err = clGetKernelWorkGroupInfo(kernel.get(), m_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_local_size), &max_local_size, NULL);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clGetKernelWorkGroupInfo", err);
+  }
+
+  // The map owns them from here on, for the engine's lifetime.
+  TypedKernel& typed = m_typed_kernels[options];
+  typed.program = std::move(program);
+  typed.kernel = std::move(kernel);
+  typed.max_local_size = max_local_size;
+  return typed;
+}
+
+double OpenCLEngine::add_typed(const std::string& options, size_t element_size, void* c, const void* a, const void* b,
+                               size_t N, AddProfile* profile)
+{
+  if (N > CL_UINT_MAX) {
+    throw std::invalid_argument("add_typed: N exceeds 32-bit kernel indexing");
+  }
+  const TypedKernel& typed = typed_kernel(options);
+  if (N == 0) {
+    if (profile) {
+      *profile = AddProfile();
+    }
+    return 0.0;
+  }
+
+  size_t bytes = element_size * N;
+  PooledBuffer a_device(*m_pool, bytes, CL_MEM_READ_ONLY);
+  PooledBuffer b_device(*m_pool, bytes, CL_MEM_READ_ONLY);
+  PooledBuffer c_device(*m_pool, bytes, CL_MEM_WRITE_ONLY);
+  EventHandle writes[2], kernel, read;
+  QueueFinish finish(m_queue.get());
+
+  cl_int err = clEnqueueWriteBuffer(m_queue.get(), a_device.get(), CL_FALSE, 0, bytes, a, 0, NULL, writes[0].out());
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueWriteBuffer", err);
+  }
+  err = clEnqueueWriteBuffer(m_queue.get(), b_device.get(), CL_FALSE, 0, bytes, b, 0, NULL, writes[1].out());
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueWriteBuffer", err);
+  }
+
+  // Same geometry as add_int4: one work-item per four elements, plus one
+  // for the tail, padded to whole work groups.
+  cl_kernel typed_add = typed.kernel.get();
+  cl_uint n = (cl_uint)N;
+  cl_mem buffers[3] = { c_device.get(), a_device.get(), b_device.get() };
+  err  = clSetKernelArg(typed_add, 0, sizeof(cl_mem), &buffers[0]);
+  err |= clSetKernelArg(typed_add, 1, sizeof(cl_mem), &buffers[1]);
+  err |= clSetKernelArg(typed_add, 2, sizeof(cl_mem), &buffers[2]);
+  err |= clSetKernelArg(typed_add, 3, sizeof(cl_uint), &n);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clSetKernelArg", err);
+  }
+  size_t local_size = typed.max_local_size;
+  size_t work_items = (N + 3) / 4;
+  size_t global_size = (work_items + local_size - 1) / local_size * local_size;
+  cl_event wait_list[2] = { writes[0].get(), writes[1].get() };
+  err = clEnqueueNDRangeKernel(m_queue.get(), typed_add, 1, NULL, &global_size, &local_size, 2, wait_list, kernel.out());
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueNDRangeKernel", err);
+  }
+
+  cl_event kernel_event = kernel.get();
+  err = clEnqueueReadBuffer(m_queue.get(), c_device.get(), CL_TRUE, 0, bytes, c, 1, &kernel_event, read.out());
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clEnqueueReadBuffer", err);
+  }
+
+  AddProfile stages;
+  stages.write_a = stage_timing(writes[0].get());
+  stages.write_b = stage_timing(writes[1].get());
+  stages.kernel = stage_timing(kernel.get());
+  stages.read = stage_timing(read.get());
+  trace_add_events(writes[0].get(), writes[1].get(), kernel.get(), read.get());
+
+  if (profile) {
+    *profile = stages;
+  }
+  return stages.kernel.run_seconds();
+}
@@ -0,0 +1,280 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef OPENCL_ENGINE_H__
+#define OPENCL_ENGINE_H__
+
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <OpenCL/opencl.h>
+
+#include "buffer_pool.h"
+#include "cl_handle.h"
+#include "program_cache.h"
+
+// Device timestamps of one command, in nanoseconds, from
+// clGetEventProfilingInfo. The gaps between them separate time spent in the
+// host-side queue, in the driver and on the device itself.
+struct StageTiming {
+    cl_ulong    queued;     // CL_PROFILING_COMMAND_QUEUED
+    cl_ulong    submit;     // CL_PROFILING_COMMAND_SUBMIT
+    cl_ulong    start;      // CL_PROFILING_COMMAND_START
+    cl_ulong    end;        // CL_PROFILING_COMMAND_END
+
+    StageTiming() : queued(0), submit(0), start(0), end(0) {}
+
+    double queued_seconds() const { return (submit - queued) * 1e-9; }
+    double submit_seconds() const { return (start - submit) * 1e-9; }
+    double run_seconds() const { return (end - start) * 1e-9; }
+};
+
+// Requires a queue created with CL_QUEUE_PROFILING_ENABLE and a completed
+// event.
+StageTiming stage_timing(cl_event event);
+
+// Per-stage timings of one add. Stages a path doesn't have (the writes in
+// add_zero_copy(), where `read` is the map) stay zero.
+struct AddProfile {
+    StageTiming write_a;
+    StageTiming write_b;
+    StageTiming kernel;
+    StageTiming read;
+};
+
+// An add_async() in flight: write -> kernel -> read chained through events.
+// The host arrays passed to add_async() must stay valid, and the inputs
+// unmodified, until wait() returns. Destroying a pending operation waits for
+// it. Move-only.
+class AddOperation {
+    friend class OpenCLEngine;
+
+protected:
+    PooledBuffer        m_buffers[3];   // a, b, c
+    EventHandle         m_events[4];    // write a, write b, kernel, read c
+    AddProfile          m_profile;
+
+    void reset();
+
+public:
+    AddOperation();
+    AddOperation(AddOperation&& other);
+    AddOperation& operator=(AddOperation&& other);
+    ~AddOperation();
+
+    AddOperation(const AddOperation&) = delete;
+    AddOperation& operator=(const AddOperation&) = delete;
+
+    bool pending() const { return m_buffers[0].get() != NULL; }
+
+    // True once the read-back has finished; never blocks.
+    bool ready() const;
+
+    // Blocks until the result is in host memory, then returns the device
+    // buffers to the pool. Throws if any stage failed.
+    void wait();
+
+    // Per-stage device timings, valid after wait() has returned.
+    const AddProfile& profile() const { return m_profile; }
+};
+
+// The kernels in opencl_example.cl that compute c = a + b. They share one
+// signature and differ in how many consecutive elements a work-item adds.
+enum AddKernel {
+    ADD_SCALAR,     // add: one int per work-item
+    ADD_INT4,       // add_int4
+    ADD_INT8,       // add_int8
+    ADD_INT16,      // add_int16
+    ADD_COARSE,     // add_coarse: grid-stride, ELEMENTS_PER_ITEM per pass
+    ADD_KERNEL_COUNT
+};
+
+const char* add_kernel_name(AddKernel kernel);
+
+// Consecutive elements per work-item for the vector kernels; 1 for the
+// scalar and coarsened kernels.
+size_t add_kernel_width(AddKernel kernel);
+
+// The widest vector kernel that does not exceed the device's
+// CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT, or ADD_SCALAR below 4.
+AddKernel preferred_add_kernel(cl_uint preferred_vector_width);
+
+// Whether `device` can run commands of one queue out of order
+// (CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE in CL_DEVICE_QUEUE_PROPERTIES).
+bool supports_out_of_order(cl_device_id device);
+
+// The add_typed kernel of opencl_typed.cl built for one element type.
+struct TypedKernel {
+    ProgramHandle   program;
+    KernelHandle    kernel;
+    size_t          max_local_size;
+
+    TypedKernel() : max_local_size(0) {}
+};
+
+// Owns the device, context, command queue, program and kernels for the `add`
+// example so that they are created once and reused across calls. Only the
+// buffers and the dispatch itself are handled per call.
+class OpenCLEngine {
+protected:
+    cl_device_id        m_device;
+    ContextHandle       m_context;
+    QueueHandle         m_queue;
+    ProgramHandle       m_program;
+    std::string         m_source;
+    ProgramCache        m_cache;
+    KernelHandle        m_kernels[ADD_KERNEL_COUNT];
+    size_t              m_max_local_sizes[ADD_KERNEL_COUNT];
+    AddKernel           m_add_kernel;
+    bool                m_out_of_order;
+    bool                m_fp64;
+    size_t              m_local_size;
+    cl_uint             m_compute_units;
+    unsigned int        m_elements_per_item;
+    size_t              m_host_alignment;
+    ProgramBuildInfo    m_build_info;
+    std::unique_ptr<BufferPool> m_pool;     // released before the context
+    std::string         m_typed_source;
+    std::map<std::string, TypedKernel> m_typed_kernels;   // by build options
+
+    void build_program();
+
+private:
+    OpenCLEngine(const OpenCLEngine&);
+    OpenCLEngine& operator=(const OpenCLEngine&);
+
+public:
+    // Sets up `device` (see select_devices()). Program binaries are cached in
+    // `cache_dir`; pass an empty string to always build from source. With
+    // `out_of_order`, the engine's queue may run independent commands
+    // concurrently where the device supports it; every add path orders its
+    // commands through events or blocking calls, so results are the same.
+    explicit OpenCLEngine(cl_device_id device, const std::string& cache_dir = std::string(),
+                          bool out_of_order = false);
+
+    // How the program was obtained (cache hit or source build) and how long
+    // that took.
+    const ProgramBuildInfo& build_info() const { return m_build_info; }
+
+    // Device buffers are recycled across add() calls through this pool.
+    BufferPool& pool() { return *m_pool; }
+    BufferPoolStats pool_stats() const { return m_pool->stats(); }
+
+    cl_device_id device() const { return m_device; }
+    cl_context context() const { return m_context.get(); }
+    cl_command_queue queue() const { return m_queue.get(); }
+    const ProgramCache& cache() const { return m_cache; }
+    cl_uint compute_units() const { return m_compute_units; }
+
+    // True if queue() really is out of order: requested and supported.
+    bool out_of_order() const { return m_out_of_order; }
+
+    // True if the device runs double precision: CL_DEVICE_DOUBLE_FP_CONFIG
+    // is non-zero (OpenCL 1.2), or cl_khr_fp64 is listed (older devices).
+    // The one check for whether "double" typed adds can be built.
+    bool supports_fp64() const { return m_fp64; }
+    size_t local_size() const { return m_local_size; }
+
+    // The kernel used by every add path. Defaults to preferred_add_kernel()
+    // for the device; selecting one also resets the local size to that
+    // kernel's CL_KERNEL_WORK_GROUP_SIZE.
+    AddKernel add_kernel() const { return m_add_kernel; }
+    void set_add_kernel(AddKernel kernel);
+
+    // Largest local size `kernel` supports on this device.
+    size_t max_local_size(AddKernel kernel) const { return m_max_local_sizes[kernel]; }
+
+    // Overrides the local size for the current kernel; any value up to
+    // max_local_size() works since the global size is padded to match.
+    void set_local_size(size_t local_size);
+
+    // ELEMENTS_PER_ITEM for add_coarse. It is a compile-time constant, so
+    // changing it rebuilds the program (through the program cache).
+    unsigned int elements_per_item() const { return m_elements_per_item; }
+    void set_elements_per_item(unsigned int elements_per_item);
+
+    // Creates an additional command queue on the engine's context and
+    // device. The caller releases it.
+    cl_command_queue create_queue(cl_command_queue_properties properties = 0);
+
+    // Enqueues the `add` kernel over N elements of device buffers on `queue`,
+    // after the events in `wait_list`. N need not be a multiple of the local
+    // size. Building block for pipelines that manage their own buffers and
+    // queues.
+    void enqueue_add(cl_command_queue queue, cl_mem c, cl_mem a, cl_mem b, size_t N,
+                     cl_uint num_events, const cl_event* wait_list, cl_event* event);
+
+    // A new instance of the add_kernel() kernel, for a thread that needs to
+    // set arguments without racing other threads. The caller releases it.
+    cl_kernel create_add_kernel() const;
+
+    // A new instance of any kernel in opencl_example.cl, e.g. the
+    // reductions. The caller releases it.
+    cl_kernel create_kernel(const char* name) const;
+
+    // enqueue_add() with `kernel`, an instance from create_add_kernel(),
+    // instead of the engine's own. Only reads engine state, so threads
+    // with their own kernel and queue can call it concurrently as long as
+    // nobody reconfigures the engine meanwhile.
+    void enqueue_add(cl_kernel kernel, cl_command_queue queue, cl_mem c, cl_mem a, cl_mem b, size_t N,
+                     cl_uint num_events, const cl_event* wait_list, cl_event* event) const;
+
+    // Alignment host arrays need for add_zero_copy() to avoid hidden copies:
+    // the larger of the page size and CL_DEVICE_MEM_BASE_ADDR_ALIGN.
+    size_t host_alignment() const { return m_host_alignment; }
+
+    // Computes c = a + b over N elements and returns the kernel execution
+    // time in seconds, measured on the device from profiling events. Pass
+    // `profile` to also get the timestamps of each transfer.
+    double add(int* c, const int* a, const int* b, size_t N, AddProfile* profile = NULL);
+
+    // Same as add(), but wraps the host arrays in CL_MEM_USE_HOST_PTR buffers
+    // and maps the result instead of copying with explicit transfers. On CPU
+    // devices and integrated GPUs the kernel then works on the host memory
+    // directly. The arrays should come from allocate_aligned() with
+    // host_alignment().
+    double add_zero_copy(int* c, const int* a, const int* b, size_t N, AddProfile* profile = NULL);
+
+    // Enqueues c = a + b with non-blocking transfers and returns without
+    // waiting, so the host can prepare the next batch while the device works.
+    // For N == 0 the operation is not pending and wait() returns at once.
+    AddOperation add_async(int* c, const int* a, const int* b, size_t N);
+
+    // The add_typed kernel built with `options` (see typed_add_options()).
+    // Each distinct set of options is built, through the program cache, on
+    // first use and kept for the engine's lifetime.
+    const TypedKernel& typed_kernel(const std::string& options);
+
+    // add() for arrays of `element_size`-byte elements using
+    // typed_kernel(options). Use add_opencl<T>() rather than calling this
+    // directly.
+    double add_typed(const std::string& options, size_t element_size, void* c, const void* a, const void* b,
+                     size_t N, AddProfile* profile = NULL);
+};
+
+#endif // OPENCL_ENGINE_H__
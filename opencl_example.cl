@@ -25,10 +25,207 @@
   For more information, please refer to <http://unlicense.org/>
 */
 
-__kernel void add(__global int* c, __global int* a, __global int* b)
+// The global size is padded up to a multiple of the work-group size, so
+// work-items past the end of the arrays do nothing.
+__kernel void add(__global int* c, __global const int* a, __global const int* b, const uint n)
 {
-   int i = get_global_id(0);
-   c[i] = a[i] + b[i];
+   uint i = get_global_id(0);
+   if (i < n) {
+      c[i] = a[i] + b[i];
+   }
 }
 
+// Vectorized variants: each work-item adds W consecutive elements with
+// vloadW/vstoreW, so only about n / W work-items are needed. The work-item
+// just past the last full vector handles the n % W tail elements.
+__kernel void add_int4(__global int* c, __global const int* a, __global const int* b, const uint n)
+{
+   uint i = get_global_id(0);
+   uint vectors = n / 4;
+   if (i < vectors) {
+      vstore4(vload4(i, a) + vload4(i, b), i, c);
+   } else if (i == vectors) {
+      for (uint j = i * 4; j < n; j++) {
+         c[j] = a[j] + b[j];
+      }
+   }
+}
+
+__kernel void add_int8(__global int* c, __global const int* a, __global const int* b, const uint n)
+{
+   uint i = get_global_id(0);
+   uint vectors = n / 8;
+   if (i < vectors) {
+      vstore8(vload8(i, a) + vload8(i, b), i, c);
+   } else if (i == vectors) {
+      for (uint j = i * 8; j < n; j++) {
+         c[j] = a[j] + b[j];
+      }
+   }
+}
+
+__kernel void add_int16(__global int* c, __global const int* a, __global const int* b, const uint n)
+{
+   uint i = get_global_id(0);
+   uint vectors = n / 16;
+   if (i < vectors) {
+      vstore16(vload16(i, a) + vload16(i, b), i, c);
+   } else if (i == vectors) {
+      for (uint j = i * 16; j < n; j++) {
+         c[j] = a[j] + b[j];
+      }
+   }
+}
+
+// Elements each work-item of add_coarse handles per pass of its loop. Set
+// by the host with -DELEMENTS_PER_ITEM=<n>.
+#ifndef ELEMENTS_PER_ITEM
+#define ELEMENTS_PER_ITEM 4
+#endif
+
+// Coarsened, grid-stride variant: the host launches a fixed number of
+// work-items sized to the device, and each one walks the arrays in steps of
+// the global size. Neighbouring work-items still touch neighbouring elements,
+// so accesses stay coalesced.
+__kernel void add_coarse(__global int* c, __global const int* a, __global const int* b, const uint n)
+{
+   size_t stride = get_global_size(0);
+   size_t i = get_global_id(0);
+   for (; i + (ELEMENTS_PER_ITEM - 1) * stride < n; i += ELEMENTS_PER_ITEM * stride) {
+      for (uint k = 0; k < ELEMENTS_PER_ITEM; k++) {
+         size_t j = i + k * stride;
+         c[j] = a[j] + b[j];
+      }
+   }
+   for (; i < n; i += stride) {
+      c[i] = a[i] + b[i];
+   }
+}
+
+// Reductions. Each work-item first folds a grid-stride slice of the input
+// into a private value, then the work group combines those in local memory
+// as a tree, halving the active work-items after every barrier, and
+// work-item 0 writes one partial result per group. A second launch with a
+// single work group reduces the partials. The tree needs a power-of-two
+// local size, which the host guarantees.
+
+long group_sum(__local long* scratch, long value)
+{
+   uint lid = get_local_id(0);
+   scratch[lid] = value;
+   barrier(CLK_LOCAL_MEM_FENCE);
+   for (uint s = get_local_size(0) / 2; s > 0; s >>= 1) {
+      if (lid < s) {
+         scratch[lid] += scratch[lid + s];
+      }
+      barrier(CLK_LOCAL_MEM_FENCE);
+   }
+   return scratch[0];
+}
 
+int group_min(__local int* scratch, int value)
+{
+   uint lid = get_local_id(0);
+   scratch[lid] = value;
+   barrier(CLK_LOCAL_MEM_FENCE);
+   for (uint s = get_local_size(0) / 2; s > 0; s >>= 1) {
+      if (lid < s) {
+         scratch[lid] = min(scratch[lid], scratch[lid + s]);
+      }
+      barrier(CLK_LOCAL_MEM_FENCE);
+   }
+   return scratch[0];
+}
+
+int group_max(__local int* scratch, int value)
+{
+   uint lid = get_local_id(0);
+   scratch[lid] = value;
+   barrier(CLK_LOCAL_MEM_FENCE);
+   for (uint s = get_local_size(0) / 2; s > 0; s >>= 1) {
+      if (lid < s) {
+         scratch[lid] = max(scratch[lid], scratch[lid + s]);
+      }
+      barrier(CLK_LOCAL_MEM_FENCE);
+   }
+   return scratch[0];
+}
+
+// Sums are accumulated in 64 bits so that they don't overflow.
+__kernel void reduce_sum(__global const int* in, __global long* partials, __local long* scratch, const uint n)
+{
+   long sum = 0;
+   for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+      sum += in[i];
+   }
+   sum = group_sum(scratch, sum);
+   if (get_local_id(0) == 0) {
+      partials[get_group_id(0)] = sum;
+   }
+}
+
+// Second stage for reduce_sum, reduce_dot and add_sum.
+__kernel void reduce_sum_long(__global const long* in, __global long* partials, __local long* scratch, const uint n)
+{
+   long sum = 0;
+   for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+      sum += in[i];
+   }
+   sum = group_sum(scratch, sum);
+   if (get_local_id(0) == 0) {
+      partials[get_group_id(0)] = sum;
+   }
+}
+
+// Also the second stage of itself, since partials are ints too.
+__kernel void reduce_min(__global const int* in, __global int* partials, __local int* scratch, const uint n)
+{
+   int value = INT_MAX;
+   for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+      value = min(value, in[i]);
+   }
+   value = group_min(scratch, value);
+   if (get_local_id(0) == 0) {
+      partials[get_group_id(0)] = value;
+   }
+}
+
+__kernel void reduce_max(__global const int* in, __global int* partials, __local int* scratch, const uint n)
+{
+   int value = INT_MIN;
+   for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+      value = max(value, in[i]);
+   }
+   value = group_max(scratch, value);
+   if (get_local_id(0) == 0) {
+      partials[get_group_id(0)] = value;
+   }
+}
+
+__kernel void reduce_dot(__global const int* a, __global const int* b, __global long* partials, __local long* scratch,
+                         const uint n)
+{
+   long sum = 0;
+   for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+      sum += (long)a[i] * b[i];
+   }
+   sum = group_sum(scratch, sum);
+   if (get_local_id(0) == 0) {
+      partials[get_group_id(0)] = sum;
+   }
+}
+
+// add fused with reduce_sum: the sum of c = a + b (each element wrapping
+// as in add) without ever storing c, so only the partials leave the device.
+__kernel void add_sum(__global const int* a, __global const int* b, __global long* partials, __local long* scratch,
+                      const uint n)
+{
+   long sum = 0;
+   for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+      sum += (int)((uint)a[i] + (uint)b[i]);
+   }
+   sum = group_sum(scratch, sum);
+   if (get_local_id(0) == 0) {
+      partials[get_group_id(0)] = sum;
+   }
+}
@@ -28,180 +28,1162 @@
 /*
   Built with:
   
-    g++ opencl_example.cpp timer.cpp -o opencl_example -framework OpenCL
+    xxd -i opencl_example.cl > opencl_example_cl.h
+    xxd -i opencl_typed.cl > opencl_typed_cl.h
+    g++ -std=c++11 opencl_example.cpp autotune.cpp batcher.cpp benchmark.cpp buffer_pool.cpp cl_handle.cpp concurrent_engine.cpp devices.cpp dispatcher.cpp expr.cpp host_memory.cpp host_ops.cpp kernel_source.cpp mapped_file.cpp multi_device.cpp native_add.cpp opencl_engine.cpp program_cache.cpp reduce.cpp stream_add.cpp thread_pool.cpp timer.cpp trace.cpp typed_add.cpp -o opencl_example -framework OpenCL
     
+  The xxd steps embed the kernels in the executable and must be rerun after
+  editing a .cl file; --kernel-source reads them from a directory instead.
+  
   Run with:
   
     ./opencl_example --use-cpu
     ./opencl_example --use-gpu
+    ./opencl_example --devices gpu:0,gpu:1,cpu
+    ./opencl_example --devices all
+    ./opencl_example --devices "GeForce"
+    ./opencl_example --devices fastest:gpu
+    ./opencl_example --list-devices
+    ./opencl_example --use-gpu --size-sweep
+    ./opencl_example --use-cpu --vector-width 8
+    ./opencl_example --use-cpu --elements-per-item 16
+    ./opencl_example --use-gpu --autotune
+    ./opencl_example --use-gpu --cache-dir /tmp/opencl_cache
+    ./opencl_example --use-gpu --no-cache
+    ./opencl_example --use-gpu --kernel-source .
+    ./opencl_example --use-cpu --zero-copy
+    ./opencl_example --use-cpu --zero-copy --huge-pages
+    ./opencl_example --use-gpu --async
+    ./opencl_example --use-gpu --benchmark --warmup 3 --repetitions 20
+    ./opencl_example --use-gpu --benchmark --sweep --format csv --output add.csv
+    ./opencl_example --use-gpu --benchmark --sweep --format json --peak-bandwidth 448
+    ./opencl_example --use-gpu --compare-native
+    ./opencl_example --dispatch --elements 67108864
+    ./opencl_example --use-gpu --batch --batch-size 128 --batch-wait 200
+    ./opencl_example --use-gpu --threads 8
+    ./opencl_example --use-gpu --type half
+    ./opencl_example --use-gpu --type short --saturate
+    ./opencl_example --use-gpu --fused
+    ./opencl_example --use-gpu --reduce
+    ./opencl_example --use-gpu --input-a a.bin --input-b b.bin --output-c c.bin
+    ./opencl_example --use-gpu --validation sampled --validation-samples 10000
+    ./opencl_example --use-gpu --stream --elements 1073741824 --chunk-size 8388608 --pipeline-depth 3 --queues 2
+    ./opencl_example --devices gpu:0,gpu:1 --trace add.json
+    ./opencl_example --use-gpu --stream --out-of-order --queues 1
+    ./opencl_example --use-gpu --queue-modes --chunk-size 4194304 --repetitions 5
 */
 
-#include <fstream>
+#include <algorithm>
 #include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <stdexcept>
-#include <OpenCL/opencl.h>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "autotune.h"
+#include "batcher.h"
+#include "benchmark.h"
+#include "concurrent_engine.h"
+#include "devices.h"
+#include "dispatcher.h"
+#include "expr.h"
+#include "host_memory.h"
+#include "host_ops.h"
+#include "kernel_source.h"
+#include "mapped_file.h"
+#include "multi_device.h"
+#include "opencl_engine.h"
+#include "reduce.h"
+#include "stream_add.h"
 #include "timer.h"
+#include "trace.h"
+#include "typed_add.h"
+
+// `checksum` is what fill_operands() returned for the inputs.
+double add_opencl(OpenCLEngine& engine, int* c_host, int* a_host, int* b_host, size_t N, bool zero_copy,
+                  uint64_t checksum, const ValidationOptions& validation, AddProfile* profile = NULL)
+{
+  double execution_time = zero_copy ? engine.add_zero_copy(c_host, a_host, b_host, N, profile)
+                                    : engine.add(c_host, a_host, b_host, N, profile);
+  
+  // Validate the output array.
+  validate_add(c_host, a_host, b_host, N, checksum, validation);
+  
+  return execution_time;
+}
+
+// Prints, per stage, how long each command sat in the queue, how long the
+// driver took to start it once submitted, and how long it ran.
+void print_profile(const AddProfile& profile)
+{
+  const char* names[] = { "write a", "write b", "kernel", "read c" };
+  const StageTiming* stages[] = { &profile.write_a, &profile.write_b, &profile.kernel, &profile.read };
+  
+  std::cout << std::left << std::setw(10) << "Stage" << std::right
+            << std::setw(17) << "queued->submit" << std::setw(17) << "submit->start"
+            << std::setw(17) << "start->end" << std::endl;
+  for (size_t i = 0; i < 4; i++) {
+    if (stages[i]->end == 0) {
+      continue;
+    }
+    std::cout << std::left << std::setw(10) << names[i] << std::right
+              << std::setw(15) << stages[i]->queued_seconds() * 1e3 << "ms"
+              << std::setw(15) << stages[i]->submit_seconds() * 1e3 << "ms"
+              << std::setw(15) << stages[i]->run_seconds() * 1e3 << "ms" << std::endl;
+  }
+}
 
-float add_opencl(bool use_gpu, int* c_host, int* a_host, int* b_host, int N)
+// Splits the arrays into batches and prepares batch k + 1 on the host while
+// batch k is still running on the device. Returns the total time.
+double add_opencl_async(OpenCLEngine& engine, int* c_host, int* a_host, int* b_host, size_t N, size_t batches,
+                        const ValidationOptions& validation)
 {
-  // Create a context.
-  cl_device_id device_id;
+  Timer total_timer;
+  total_timer.start();
   
-  cl_int err = clGetDeviceIDs(NULL, use_gpu ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU, 1, &device_id, NULL);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("clGetDeviceIDs");
+  size_t batch_size = (N + batches - 1) / batches;
+  std::vector<AddOperation> operations;
+  uint64_t checksum = 0;
+  for (size_t begin = 0; begin < N; begin += batch_size) {
+    size_t end = std::min(N, begin + batch_size);
+    checksum += fill_operands(a_host, b_host, begin, end);
+    operations.push_back(engine.add_async(c_host + begin, a_host + begin, b_host + begin, end - begin));
   }
+  for (size_t i = 0; i < operations.size(); i++) {
+    operations[i].wait();
+  }
+  
+  total_timer.stop();
+  
+  validate_add(c_host, a_host, b_host, N, checksum, validation);
+  
+  return total_timer.elapsed();
+}
 
-  cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
-  if (!context) {
-    throw std::runtime_error("clCreateContext");
+// Times adds at sizes that are not powers of two (and not multiples of any
+// work-group size), which only work because the global size is padded.
+void add_size_sweep(OpenCLEngine& engine, size_t max_N, const ValidationOptions& validation)
+{
+  static const size_t sizes[] = { 1, 3, 1000, 65537, 1000003, 3 * 1024 * 1024 + 7, 10000019, 33554431 };
+  
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= max_N; s++) {
+    size_t N = sizes[s];
+    std::vector<int> a(N);
+    std::vector<int> b(N);
+    std::vector<int> c(N);
+    uint64_t checksum = fill_operands(&a[0], &b[0], 0, N);
+    
+    double opencl_time = add_opencl(engine, &c[0], &a[0], &b[0], N, false, checksum, validation);
+    std::cout << "N = " << N << ": " << opencl_time << "s";
+    if (opencl_time > 0.0) {
+      std::cout << ", " << 3.0 * sizeof(int) * N / opencl_time * 1e-9 << " GB/s";
+    }
+    std::cout << std::endl;
   }
+}
 
-  // Create a command queue.
-  cl_command_queue commands = clCreateCommandQueue(context, device_id, 0, &err);
-  if (!commands) {
-    throw std::runtime_error("clCreateCommandQueue");
+// Runs one add split across every device in `devices`.
+void add_multi_device(const std::vector<cl_device_id>& devices, const std::string& cache_dir, size_t N,
+                      const ValidationOptions& validation)
+{
+  // Nothing to add, and &v[0] of an empty vector is undefined.
+  if (N == 0) {
+    return;
   }
   
-  // Load the source code from the file.
-  std::ifstream source_file("opencl_example.cl");    
-  std::string source((std::istreambuf_iterator<char>(source_file)), std::istreambuf_iterator<char>());
-  const char* source_cstr = source.c_str();
+  MultiDeviceAdd multi(devices, cache_dir);
+  multi.calibrate(std::min(N, (size_t)4 * 1024 * 1024));
+  
+  std::vector<int> a(N);
+  std::vector<int> b(N);
+  std::vector<int> c(N);
+  uint64_t checksum = fill_operands(&a[0], &b[0], 0, N);
+  
+  MultiDeviceResult result = multi.add(&c[0], &a[0], &b[0], N);
+  validate_add(&c[0], &a[0], &b[0], N, checksum, validation);
+  
+  std::cout << "OpenCL multi-device time: " << result.seconds << "s" << std::endl;
+  for (size_t i = 0; i < result.partitions.size(); i++) {
+    const DevicePartition& partition = result.partitions[i];
+    std::cout << "  " << device_name(devices[i]) << ": " << partition.count << " elements in "
+              << partition.seconds << "s" << std::endl;
+  }
+}
 
-  // Create a program from the source buffer.
-  cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source_cstr, NULL, &err);
-  if (!program) {
-    throw std::runtime_error("clCreateProgramWithSource");
+// Routes adds from 1K elements up to N, growing 4x at a time, through a
+// Dispatcher and reports where each went against the cost models.
+void add_dispatched(const std::string& cache_dir, size_t N, const ValidationOptions& validation)
+{
+  Dispatcher dispatcher(cache_dir, std::min(N, (size_t)16 * 1024 * 1024));
+  for (size_t backend = 0; backend < BACKEND_COUNT; backend++) {
+    const CostModel& model = dispatcher.model((Backend)backend);
+    if (dispatcher.available((Backend)backend)) {
+      std::cout << "Cost model " << backend_name((Backend)backend) << ": "
+                << model.latency_seconds * 1e6 << "us + bytes / " << model.bytes_per_second * 1e-9 << " GB/s"
+                << std::endl;
+    }
   }
   
-  // Build the program.
-  err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("clBuildProgram");
+  std::vector<int> a(N);
+  std::vector<int> b(N);
+  std::vector<int> c(N);
+  for (size_t n = std::min(N, (size_t)1024); n > 0 && n <= N; n *= 4) {
+    uint64_t checksum = fill_operands(&a[0], &b[0], 0, n);
+    Timer timer;
+    timer.start();
+    Backend backend = dispatcher.add(&c[0], &a[0], &b[0], n);
+    timer.stop();
+    validate_add(&c[0], &a[0], &b[0], n, checksum, validation);
+    std::cout << "N = " << n << ": " << backend_name(backend) << ", predicted "
+              << dispatcher.model(backend).seconds(n) * 1e3 << "ms, took " << timer.elapsed() * 1e3 << "ms"
+              << std::endl;
   }
+}
 
-  // Extract the compute kernel from the program.
-  cl_kernel kernel = clCreateKernel(program, "add", &err);
-  if (!kernel || err != CL_SUCCESS) {
-    throw std::runtime_error("clCreateKernel");
+// Runs `jobs` small adds of 1K to 64K elements, first one add() call each
+// and then from four threads through an AddBatcher, and compares the two.
+void add_batched(OpenCLEngine& engine, size_t jobs, const BatcherConfig& config, const ValidationOptions& validation)
+{
+  static const size_t kProducers = 4;
+  
+  std::vector<size_t> offsets(1, 0);
+  for (size_t i = 0; i < jobs; i++) {
+    offsets.push_back(offsets.back() + ((size_t)1024 << (i % 7)));
   }
+  size_t N = offsets.back();
+  std::vector<int> a(N);
+  std::vector<int> b(N);
+  std::vector<int> c(N);
+  uint64_t checksum = fill_operands(&a[0], &b[0], 0, N);
   
-  // Create the device buffers for our kernel (two inputs, one output).
-  cl_mem a_device = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * N, NULL, NULL);
-  cl_mem b_device = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * N, NULL, NULL);
-  cl_mem c_device = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(int) * N, NULL, NULL);
-  if (!a_device || !b_device || !c_device) {
-    throw std::runtime_error("clCreateBuffer");
+  Timer single_timer;
+  single_timer.start();
+  for (size_t i = 0; i < jobs; i++) {
+    engine.add(&c[offsets[i]], &a[offsets[i]], &b[offsets[i]], offsets[i + 1] - offsets[i]);
   }
+  single_timer.stop();
+  validate_add(&c[0], &a[0], &b[0], N, checksum, validation);
+  std::cout << "One launch per job (" << jobs << " jobs, " << N << " elements): "
+            << single_timer.elapsed() << "s" << std::endl;
   
-  // Write the input arrays into device memory.
-  err = clEnqueueWriteBuffer(commands, a_device, CL_TRUE, 0, sizeof(int) * N, a_host, 0, NULL, NULL);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("clEnqueueWriteBuffer");
+  std::fill(c.begin(), c.end(), 0);
+  Timer batch_timer;
+  BatcherStats stats;
+  batch_timer.start();
+  {
+    AddBatcher batcher(engine, config);
+    std::vector<std::thread> producers;
+    std::vector<std::exception_ptr> errors(kProducers);
+    for (size_t p = 0; p < kProducers; p++) {
+      producers.push_back(std::thread([&, p]() {
+        try {
+          std::vector<std::future<void> > results;
+          for (size_t i = p; i < jobs; i += kProducers) {
+            results.push_back(batcher.submit(&c[offsets[i]], &a[offsets[i]], &b[offsets[i]], offsets[i + 1] - offsets[i]));
+          }
+          for (size_t i = 0; i < results.size(); i++) {
+            results[i].get();
+          }
+        } catch (...) {
+          errors[p] = std::current_exception();
+        }
+      }));
+    }
+    for (size_t p = 0; p < kProducers; p++) {
+      producers[p].join();
+    }
+    for (size_t p = 0; p < kProducers; p++) {
+      if (errors[p]) {
+        std::rethrow_exception(errors[p]);
+      }
+    }
+    stats = batcher.stats();
   }
+  batch_timer.stop();
+  validate_add(&c[0], &a[0], &b[0], N, checksum, validation);
+  std::cout << "Batched from " << kProducers << " threads: " << batch_timer.elapsed() << "s, "
+            << stats.batches << " launches, " << (double)stats.jobs / std::max(stats.batches, (size_t)1)
+            << " jobs per launch" << std::endl;
+}
 
-  err = clEnqueueWriteBuffer(commands, b_device, CL_TRUE, 0, sizeof(int) * N, b_host, 0, NULL, NULL);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("clEnqueueWriteBuffer");
+// Measures aggregate throughput with 1, 2, 4, ... up to `threads` callers
+// sharing the engine through a ConcurrentEngine, each running its own adds
+// of up to 1M elements.
+void add_concurrent(OpenCLEngine& engine, size_t N, size_t threads, const ValidationOptions& validation)
+{
+  static const size_t kAddsPerThread = 8;
+  
+  size_t n = std::min(N, (size_t)1024 * 1024);
+  ConcurrentEngine concurrent(engine, threads);
+  std::vector<std::vector<int> > a(threads, std::vector<int>(n));
+  std::vector<std::vector<int> > b(threads, std::vector<int>(n));
+  std::vector<std::vector<int> > c(threads, std::vector<int>(n));
+  std::vector<uint64_t> checksums(threads);
+  for (size_t t = 0; t < threads; t++) {
+    checksums[t] = fill_operands(&a[t][0], &b[t][0], 0, n);
   }
-
-  // Set the arguments to the kernel
-  err = 0;
-  err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &c_device);
-  err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &a_device);
-  err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &b_device);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("clSetKernelArg");
+  
+  std::vector<size_t> caller_counts;
+  for (size_t callers = 1; callers < threads; callers *= 2) {
+    caller_counts.push_back(callers);
+  }
+  caller_counts.push_back(threads);
+  
+  for (size_t k = 0; k < caller_counts.size(); k++) {
+    size_t callers = caller_counts[k];
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(callers);
+    Timer timer;
+    timer.start();
+    for (size_t t = 0; t < callers; t++) {
+      workers.push_back(std::thread([&, t]() {
+        try {
+          for (size_t i = 0; i < kAddsPerThread; i++) {
+            concurrent.add(&c[t][0], &a[t][0], &b[t][0], n);
+          }
+        } catch (...) {
+          errors[t] = std::current_exception();
+        }
+      }));
+    }
+    for (size_t t = 0; t < callers; t++) {
+      workers[t].join();
+    }
+    timer.stop();
+    for (size_t t = 0; t < callers; t++) {
+      if (errors[t]) {
+        std::rethrow_exception(errors[t]);
+      }
+      validate_add(&c[t][0], &a[t][0], &b[t][0], n, checksums[t], validation);
+    }
+    
+    double bytes = 3.0 * sizeof(int) * n * kAddsPerThread * callers;
+    std::cout << callers << " caller thread" << (callers == 1 ? "" : "s") << ": " << timer.elapsed() << "s, "
+              << bytes / timer.elapsed() * 1e-9 << " GB/s aggregate" << std::endl;
   }
+}
 
-  // Get the maximum work group size for the device we're using.
-  size_t local_size = 0;
-  err = clGetKernelWorkGroupInfo(kernel, device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(local_size), &local_size, NULL);
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("clGetKernelWorkGroupInfo");
+// Host-side conversions for the --type test data; Half needs its own.
+template <typename T> T from_integer(int64_t value) { return (T)value; }
+template <> Half from_integer<Half>(int64_t value) { return float_to_half((float)value); }
+
+// The expected a + b: wrapped or clamped for integer types, and rounded
+// back to the element type for floating ones.
+template <typename T>
+T expected_sum(T a, T b, bool saturate)
+{
+  if (!DeviceType<T>::is_integer) {
+    return (T)(a + b);
+  }
+  // a + b in T promotes narrow types to int, so compute wide and narrow
+  // explicitly. The test values never overflow the 64-bit types.
+  int64_t sum = (int64_t)a + (int64_t)b;
+  if (saturate && sizeof(T) < sizeof(int64_t)) {
+    sum = std::max(sum, (int64_t)std::numeric_limits<T>::min());
+    sum = std::min(sum, (int64_t)std::numeric_limits<T>::max());
   }
+  return (T)sum;
+}
+
+template <>
+Half expected_sum<Half>(Half a, Half b, bool)
+{
+  return float_to_half(half_to_float(a) + half_to_float(b));
+}
 
-  Timer execution_timer;
-  execution_timer.start();
-  {{
-    // Execute the kernel over the entire arrays using the maximum number
-    // of work group items (i.e., local_size) for this device.
-    size_t global_size = N;
-    err = clEnqueueNDRangeKernel(commands, kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
-    if (err != CL_SUCCESS) {
-      throw std::runtime_error("clEnqueueNDRangeKernel");
+// Runs add_opencl<T>() over N elements. The values stay below 400, which
+// float and half add exactly and which overflows the 8-bit types either
+// way, so --saturate has something to clamp.
+template <typename T>
+void add_typed(OpenCLEngine& engine, size_t N, bool saturate, const ValidationOptions& validation)
+{
+  std::vector<T> a(N);
+  std::vector<T> b(N);
+  std::vector<T> c(N);
+  parallel_for(0, N, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      a[i] = from_integer<T>(i % 200);
+      b[i] = from_integer<T>((7 * i + 3) % 200);
+    }
+  });
+  
+  T* c_host = c.empty() ? NULL : &c[0];
+  double seconds = add_opencl<T>(engine, c_host, a.empty() ? NULL : &a[0], b.empty() ? NULL : &b[0], N, saturate);
+  
+  // There is no checksum for the non-int types, so sampled validation only
+  // checks the sampled elements.
+  if (validation.mode == VALIDATE_FULL) {
+    parallel_for(0, N, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        T expected = expected_sum(a[i], b[i], saturate);
+        if (memcmp(&expected, &c[i], sizeof(T)) != 0) {
+          throw std::runtime_error("Result validation failed");
+        }
+      }
+    });
+  } else if (validation.mode == VALIDATE_SAMPLED) {
+    std::vector<size_t> indices = sample_indices(N, validation.samples);
+    for (size_t s = 0; s < indices.size(); s++) {
+      T expected = expected_sum(a[indices[s]], b[indices[s]], saturate);
+      if (memcmp(&expected, &c[indices[s]], sizeof(T)) != 0) {
+        throw std::runtime_error("Result validation failed: sampled element mismatch");
+      }
     }
+  }
+  
+  std::cout << "OpenCL " << DeviceType<T>::name() << (saturate ? " saturating" : "") << " add: "
+            << seconds << "s";
+  if (seconds > 0.0) {
+    std::cout << ", " << 3.0 * sizeof(T) * N / seconds * 1e-9 << " GB/s, " << N / seconds << " elements/s";
+  }
+  std::cout << std::endl;
+}
 
-    // Wait for the command commands to get serviced before reading back results
-    clFinish(commands);
-  }}
-  execution_timer.stop();
+// Computes d = (a + b) * s + c on floats once as a single fused kernel and
+// once as two kernels with a temporary, to show what fusion saves. The
+// values are small integers and halves, so every rounding is exact and
+// the host check can compare for equality.
+void add_fused(OpenCLEngine& engine, size_t N, const ValidationOptions& validation)
+{
+  if (N == 0) {
+    return;
+  }
+  
+  Expr a = Expr::array("a");
+  Expr b = Expr::array("b");
+  Expr c = Expr::array("c");
+  Expr t = Expr::array("t");
+  Expr s = Expr::scalar("s");
+  
+  FusedKernel<cl_float> fused(engine, (a + b) * s + c);
+  FusedKernel<cl_float> first(engine, a + b);
+  FusedKernel<cl_float> second(engine, t * s + c);
+  std::cout << "Fused kernel (program cache " << (fused.build_info().cache_hit ? "hit" : "miss") << "):" << std::endl
+            << fused.source();
+  
+  std::vector<cl_float> a_host(N);
+  std::vector<cl_float> b_host(N);
+  std::vector<cl_float> c_host(N);
+  std::vector<cl_float> t_host(N);
+  std::vector<cl_float> d_host(N);
+  parallel_for(0, N, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      a_host[i] = (cl_float)(i % 1000);
+      b_host[i] = (cl_float)((7 * i) % 1000);
+      c_host[i] = (cl_float)((3 * i) % 1000);
+    }
+  });
+  std::vector<cl_float> scalars(1, 0.5f);
   
-  // Read the output array from device memory into host memory.
-  err = clEnqueueReadBuffer(commands, c_device, CL_TRUE, 0, sizeof(int) * N, c_host, 0, NULL, NULL);  
-  if (err != CL_SUCCESS) {
-    throw std::runtime_error("clEnqueueReadBuffer");
+  Timer fused_timer;
+  fused_timer.start();
+  double fused_kernel = fused.run(&d_host[0], { &a_host[0], &b_host[0], &c_host[0] }, scalars, N);
+  fused_timer.stop();
+  if (validation.mode == VALIDATE_FULL) {
+    parallel_for(0, N, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        if (d_host[i] != (a_host[i] + b_host[i]) * 0.5f + c_host[i]) {
+          throw std::runtime_error("Result validation failed");
+        }
+      }
+    });
+  } else if (validation.mode == VALIDATE_SAMPLED) {
+    std::vector<size_t> indices = sample_indices(N, validation.samples);
+    for (size_t s = 0; s < indices.size(); s++) {
+      size_t i = indices[s];
+      if (d_host[i] != (a_host[i] + b_host[i]) * 0.5f + c_host[i]) {
+        throw std::runtime_error("Result validation failed: sampled element mismatch");
+      }
+    }
   }
   
-  // Validate the output array.
-  for (size_t i = 0; i < N; i++) {
-    if (c_host[i] != a_host[i] + b_host[i]) {
+  // The unfused version writes t to the host and uploads it again.
+  Timer unfused_timer;
+  unfused_timer.start();
+  double unfused_kernels = first.run(&t_host[0], { &a_host[0], &b_host[0] }, std::vector<cl_float>(), N);
+  unfused_kernels += second.run(&d_host[0], { &t_host[0], &c_host[0] }, scalars, N);
+  unfused_timer.stop();
+  
+  std::cout << "Fused: " << fused_timer.elapsed() << "s total, " << fused_kernel << "s kernel" << std::endl;
+  std::cout << "Two kernels: " << unfused_timer.elapsed() << "s total, " << unfused_kernels << "s kernels" << std::endl;
+}
+
+// Runs each reduction on a and b and checks it against the host: sum, min
+// and max of a, a . b, and the sum of c = a + b fused into the add so that
+// c never leaves the device. The fused sum is timed against add() followed
+// by summing c on the host. Host sums and the dot product are compared mod
+// 2^64, which is how both sides wrap for large N.
+void add_reduce(OpenCLEngine& engine, size_t N, const ValidationOptions& validation)
+{
+  if (N == 0) {
+    return;
+  }
+  
+  std::vector<int> a(N);
+  std::vector<int> b(N);
+  std::vector<int> c(N);
+  fill_operands(&a[0], &b[0], 0, N);
+  
+  Reducer reducer(engine);
+  std::cout << "Reduction local size: " << reducer.local_size() << std::endl;
+  
+  Timer fused_timer;
+  fused_timer.start();
+  uint64_t fused_sum = (uint64_t)reducer.add_sum(&a[0], &b[0], N);
+  fused_timer.stop();
+  
+  Timer unfused_timer;
+  unfused_timer.start();
+  engine.add(&c[0], &a[0], &b[0], N);
+  uint64_t unfused_sum = 0;
+  std::mutex sum_mutex;
+  parallel_for(0, N, [&](size_t begin, size_t end) {
+    uint64_t sum = 0;
+    for (size_t i = begin; i < end; i++) {
+      sum += (uint64_t)(int64_t)c[i];
+    }
+    std::lock_guard<std::mutex> lock(sum_mutex);
+    unfused_sum += sum;
+  });
+  unfused_timer.stop();
+  
+  Timer reduce_timer;
+  reduce_timer.start();
+  uint64_t sum = (uint64_t)reducer.sum(&a[0], N);
+  int minimum = reducer.min(&a[0], N);
+  int maximum = reducer.max(&a[0], N);
+  uint64_t dot = (uint64_t)reducer.dot(&a[0], &b[0], N);
+  reduce_timer.stop();
+  
+  // Every element contributes to a reduction, so there is nothing to
+  // sample: VALIDATE_SAMPLED checks in full like VALIDATE_FULL.
+  if (validation.mode != VALIDATE_NONE) {
+    uint64_t host_sum = 0;
+    uint64_t host_dot = 0;
+    int host_min = std::numeric_limits<int>::max();
+    int host_max = std::numeric_limits<int>::min();
+    std::mutex host_mutex;
+    parallel_for(0, N, [&](size_t begin, size_t end) {
+      uint64_t block_sum = 0;
+      uint64_t block_dot = 0;
+      int block_min = std::numeric_limits<int>::max();
+      int block_max = std::numeric_limits<int>::min();
+      for (size_t i = begin; i < end; i++) {
+        block_sum += (uint64_t)(int64_t)a[i];
+        block_dot += (uint64_t)((int64_t)a[i] * b[i]);
+        block_min = std::min(block_min, a[i]);
+        block_max = std::max(block_max, a[i]);
+      }
+      std::lock_guard<std::mutex> lock(host_mutex);
+      host_sum += block_sum;
+      host_dot += block_dot;
+      host_min = std::min(host_min, block_min);
+      host_max = std::max(host_max, block_max);
+    });
+    if (fused_sum != unfused_sum || sum != host_sum || dot != host_dot || minimum != host_min || maximum != host_max) {
       throw std::runtime_error("Result validation failed");
     }
   }
   
-  clReleaseMemObject(a_device);
-  clReleaseMemObject(b_device);
-  clReleaseMemObject(c_device);
-  clReleaseProgram(program);
-  clReleaseKernel(kernel);
-  clReleaseCommandQueue(commands);
-  clReleaseContext(context);
+  std::cout << "sum(a) = " << (int64_t)sum << ", min(a) = " << minimum << ", max(a) = " << maximum
+            << ", a . b = " << (int64_t)dot << " (" << reduce_timer.elapsed() << "s)" << std::endl;
+  std::cout << "Fused add+sum: " << (int64_t)fused_sum << " in " << fused_timer.elapsed() << "s, "
+            << sizeof(cl_long) << " bytes read back" << std::endl;
+  std::cout << "add + host sum: " << (int64_t)unfused_sum << " in " << unfused_timer.elapsed() << "s, "
+            << N * sizeof(int) << " bytes read back" << std::endl;
+}
+
+// Streams c = a + b over int arrays stored in files, mapped rather than read
+// into memory. On host-unified devices the mapped pages back the device
+// buffers directly.
+void add_mapped_files(OpenCLEngine& engine, const std::string& a_path, const std::string& b_path,
+                      const std::string& c_path, StreamConfig config, const ValidationOptions& validation)
+{
+  MappedFile a = MappedFile::open_read(a_path);
+  MappedFile b = MappedFile::open_read(b_path);
+  if (a.size() != b.size() || a.size() % sizeof(int) != 0) {
+    throw std::invalid_argument("--input-a and --input-b must be int arrays of the same size");
+  }
+  size_t N = a.size() / sizeof(int);
+  // Creating the output truncates it, which would pull a mapped input out
+  // from under the add.
+  if (a.is_file(c_path) || b.is_file(c_path)) {
+    throw std::invalid_argument("--output must not be one of the input files");
+  }
+  MappedFile c = MappedFile::create(c_path, a.size());
+  if (N == 0) {
+    return;
+  }
+  
+  const int* a_host = (const int*)a.data();
+  const int* b_host = (const int*)b.data();
+  int* c_host = (int*)c.data();
   
-  return execution_timer.elapsed();
+  // mmap returns page-aligned memory, which only falls short of the
+  // device's requirement on unusual hardware; copy in that case.
+  size_t alignment = engine.host_alignment();
+  bool aligned = (size_t)a_host % alignment == 0 && (size_t)b_host % alignment == 0 && (size_t)c_host % alignment == 0;
+  config.use_host_ptr = aligned && query_device(engine.device()).host_unified_memory;
+  
+  StreamResult result = stream_add(engine, c_host, a_host, b_host, N, config);
+  c.flush();
+  
+  uint64_t checksum = validation.mode == VALIDATE_SAMPLED ? expected_checksum(a_host, b_host, N) : 0;
+  validate_add(c_host, a_host, b_host, N, checksum, validation);
+  std::cout << "OpenCL mapped-file streaming time (" << N << " elements, " << result.chunks << " chunks, "
+            << (config.use_host_ptr ? "host pointers" : "copies") << "): " << result.seconds << "s, "
+            << result.gigabytes_per_second << " GB/s" << std::endl;
 }
 
+// Options without a short form; values stay clear of the character codes.
+enum {
+  OPT_BENCHMARK = 256,
+  OPT_WARMUP,
+  OPT_REPETITIONS,
+  OPT_SWEEP,
+  OPT_FORMAT,
+  OPT_OUTPUT,
+  OPT_PEAK_BANDWIDTH,
+  OPT_VALIDATION,
+  OPT_VALIDATION_SAMPLES,
+  OPT_COMPARE_NATIVE,
+  OPT_DISPATCH,
+  OPT_BATCH,
+  OPT_BATCH_SIZE,
+  OPT_BATCH_WAIT,
+  OPT_BATCH_JOBS,
+  OPT_THREADS,
+  OPT_TYPE,
+  OPT_SATURATE,
+  OPT_FUSED,
+  OPT_INPUT_A,
+  OPT_INPUT_B,
+  OPT_OUTPUT_C,
+  OPT_REDUCE,
+  OPT_KERNEL_SOURCE,
+  OPT_TRACE,
+  OPT_HUGE_PAGES,
+  OPT_OUT_OF_ORDER,
+  OPT_QUEUE_MODES
+};
+
+// Writes the trace for --trace when main() returns, whichever mode ran.
+// Declared before the engines so that it runs after they are released.
+struct TraceOutput {
+    std::string path;
+
+    ~TraceOutput()
+    {
+      if (path.empty()) {
+        return;
+      }
+      std::ofstream out(path.c_str());
+      trace().write(out);
+      if (!out) {
+        std::cerr << "Could not write " << path << std::endl;
+      }
+    }
+};
+
 int main(int argc, char** argv)
 {
   int o = 0;
-  bool use_gpu = false;
+  std::string device_selection = "cpu:0";
+  bool list_devices = false;
+  bool zero_copy = false;
+  bool async = false;
+  bool stream = false;
+  bool size_sweep = false;
+  size_t vector_width = 0;
+  unsigned int elements_per_item = 0;
+  bool tune = false;
+  StreamConfig stream_config;
+  bool benchmark = false;
+  bool sweep = false;
+  bool compare = false;
+  bool dispatch = false;
+  bool batch = false;
+  BatcherConfig batcher_config;
+  size_t batch_jobs = 1024;
+  size_t threads = 0;
+  std::string type;
+  bool saturate = false;
+  bool fused = false;
+  bool reduce = false;
+  bool queue_modes = false;
+  TraceOutput trace_output;
+  std::string input_a;
+  std::string input_b;
+  std::string output_c;
+  BenchmarkConfig benchmark_config;
+  BenchmarkFormat format = FORMAT_TEXT;
+  std::string output_path;
+  ValidationOptions validation;
+  size_t N = 32 * 1024 * 1024;
+  std::string cache_dir = ".opencl_cache";
   
   struct option longopts[] = {
     { "use-cpu", no_argument, 0, 'c' },
     { "use-gpu", no_argument, 0, 'g' },
+    { "devices", required_argument, 0, 'x' },
+    { "list-devices", no_argument, 0, 'l' },
+    { "cache-dir", required_argument, 0, 'd' },
+    { "no-cache", no_argument, 0, 'D' },
+    { "zero-copy", no_argument, 0, 'z' },
+    { "async", no_argument, 0, 'a' },
+    { "elements", required_argument, 0, 'n' },
+    { "stream", no_argument, 0, 's' },
+    { "chunk-size", required_argument, 0, 'k' },
+    { "pipeline-depth", required_argument, 0, 'p' },
+    { "queues", required_argument, 0, 'q' },
+    { "size-sweep", no_argument, 0, 'w' },
+    { "vector-width", required_argument, 0, 'v' },
+    { "elements-per-item", required_argument, 0, 'e' },
+    { "autotune", no_argument, 0, 't' },
+    { "benchmark", no_argument, 0, OPT_BENCHMARK },
+    { "warmup", required_argument, 0, OPT_WARMUP },
+    { "repetitions", required_argument, 0, OPT_REPETITIONS },
+    { "sweep", no_argument, 0, OPT_SWEEP },
+    { "format", required_argument, 0, OPT_FORMAT },
+    { "output", required_argument, 0, OPT_OUTPUT },
+    { "peak-bandwidth", required_argument, 0, OPT_PEAK_BANDWIDTH },
+    { "validation", required_argument, 0, OPT_VALIDATION },
+    { "validation-samples", required_argument, 0, OPT_VALIDATION_SAMPLES },
+    { "compare-native", no_argument, 0, OPT_COMPARE_NATIVE },
+    { "dispatch", no_argument, 0, OPT_DISPATCH },
+    { "batch", no_argument, 0, OPT_BATCH },
+    { "batch-size", required_argument, 0, OPT_BATCH_SIZE },
+    { "batch-wait", required_argument, 0, OPT_BATCH_WAIT },
+    { "batch-jobs", required_argument, 0, OPT_BATCH_JOBS },
+    { "threads", required_argument, 0, OPT_THREADS },
+    { "type", required_argument, 0, OPT_TYPE },
+    { "saturate", no_argument, 0, OPT_SATURATE },
+    { "fused", no_argument, 0, OPT_FUSED },
+    { "input-a", required_argument, 0, OPT_INPUT_A },
+    { "input-b", required_argument, 0, OPT_INPUT_B },
+    { "output-c", required_argument, 0, OPT_OUTPUT_C },
+    { "reduce", no_argument, 0, OPT_REDUCE },
+    { "kernel-source", required_argument, 0, OPT_KERNEL_SOURCE },
+    { "trace", required_argument, 0, OPT_TRACE },
+    { "huge-pages", no_argument, 0, OPT_HUGE_PAGES },
+    { "out-of-order", no_argument, 0, OPT_OUT_OF_ORDER },
+    { "queue-modes", no_argument, 0, OPT_QUEUE_MODES },
+    { 0, 0, 0, 0 },
   };
   
-  while((o = getopt_long(argc, argv, "cg", longopts, 0)) != -1) {
+  while((o = getopt_long(argc, argv, "cgx:ld:Dzan:sk:p:q:wv:e:t", longopts, 0)) != -1) {
     switch(o) {
       case 'c':
-        use_gpu = false;
+        device_selection = "cpu:0";
         break;
       case 'g':
-        use_gpu = true;
+        device_selection = "gpu:0";
+        break;
+      case 'x':
+        device_selection = optarg;
+        break;
+      case 'l':
+        list_devices = true;
+        break;
+      case 'd':
+        cache_dir = optarg;
+        break;
+      case 'D':
+        cache_dir.clear();
+        break;
+      case 'z':
+        zero_copy = true;
+        break;
+      case 'a':
+        async = true;
+        break;
+      case 'n':
+        N = strtoull(optarg, NULL, 0);
+        break;
+      case 's':
+        stream = true;
+        break;
+      case 'k':
+        stream_config.chunk_elements = strtoull(optarg, NULL, 0);
+        break;
+      case 'p':
+        stream_config.depth = strtoull(optarg, NULL, 0);
+        break;
+      case 'q':
+        stream_config.queues = strtoull(optarg, NULL, 0);
+        break;
+      case 'w':
+        size_sweep = true;
+        break;
+      case 'v':
+        vector_width = strtoull(optarg, NULL, 0);
+        break;
+      case 'e':
+        elements_per_item = strtoul(optarg, NULL, 0);
+        break;
+      case 't':
+        tune = true;
+        break;
+      case OPT_BENCHMARK:
+        benchmark = true;
+        break;
+      case OPT_WARMUP:
+        benchmark_config.warmup = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_REPETITIONS:
+        benchmark_config.repetitions = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_SWEEP:
+        sweep = true;
+        break;
+      case OPT_FORMAT:
+        if (std::string(optarg) == "csv") {
+          format = FORMAT_CSV;
+        } else if (std::string(optarg) == "json") {
+          format = FORMAT_JSON;
+        } else if (std::string(optarg) == "text") {
+          format = FORMAT_TEXT;
+        } else {
+          throw std::invalid_argument("--format must be text, csv or json");
+        }
+        break;
+      case OPT_OUTPUT:
+        output_path = optarg;
+        break;
+      case OPT_PEAK_BANDWIDTH:
+        benchmark_config.peak_gbps = strtod(optarg, NULL);
+        break;
+      case OPT_VALIDATION:
+        if (std::string(optarg) == "full") {
+          validation.mode = VALIDATE_FULL;
+        } else if (std::string(optarg) == "sampled") {
+          validation.mode = VALIDATE_SAMPLED;
+        } else if (std::string(optarg) == "none") {
+          validation.mode = VALIDATE_NONE;
+        } else {
+          throw std::invalid_argument("--validation must be full, sampled or none");
+        }
+        break;
+      case OPT_VALIDATION_SAMPLES:
+        validation.samples = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_COMPARE_NATIVE:
+        compare = true;
+        break;
+      case OPT_DISPATCH:
+        dispatch = true;
+        break;
+      case OPT_BATCH:
+        batch = true;
+        break;
+      case OPT_BATCH_SIZE:
+        batcher_config.max_jobs = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_BATCH_WAIT:
+        // Microseconds on the command line.
+        batcher_config.max_wait_seconds = strtod(optarg, NULL) * 1e-6;
+        break;
+      case OPT_BATCH_JOBS:
+        batch_jobs = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_THREADS:
+        threads = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_TYPE:
+        type = optarg;
+        break;
+      case OPT_SATURATE:
+        saturate = true;
+        break;
+      case OPT_FUSED:
+        fused = true;
+        break;
+      case OPT_INPUT_A:
+        input_a = optarg;
+        break;
+      case OPT_INPUT_B:
+        input_b = optarg;
+        break;
+      case OPT_OUTPUT_C:
+        output_c = optarg;
+        break;
+      case OPT_REDUCE:
+        reduce = true;
+        break;
+      case OPT_KERNEL_SOURCE:
+        set_kernel_source_directory(optarg);
+        break;
+      case OPT_TRACE:
+        trace_output.path = optarg;
+        trace().enable();
+        break;
+      case OPT_HUGE_PAGES:
+        host_arena().set_huge_pages(true);
+        break;
+      case OPT_OUT_OF_ORDER:
+        stream_config.out_of_order = true;
+        break;
+      case OPT_QUEUE_MODES:
+        queue_modes = true;
         break;
       default:
         break;
     }
   }
   
-  // Allocate and initialize the data sets for the kernel.
-  unsigned int N = 32 * 1024 * 1024;
-  int* a = new int[N];
-  int* b = new int[N];
-  int* c = new int[N];
-  for (size_t i = 0; i < N; i++) {
-    a[i] = i;
-    b[i] = 2 * i;
+  if (list_devices) {
+    print_devices(std::cout, discover_devices());
+    return 0;
+  }
+  
+  // --dispatch uses every kind of backend, so it ignores --devices.
+  if (dispatch) {
+    add_dispatched(cache_dir, N, validation);
+    return 0;
+  }
+  
+  // --use-cpu and --use-gpu are shorthands for "cpu:0" and "gpu:0"; a
+  // list that selects several devices splits the add across all of them.
+  // "fastest[:<list>]" calibrates the candidates and keeps the best one.
+  std::vector<cl_device_id> devices;
+  if (device_selection.compare(0, 7, "fastest") == 0) {
+    std::string candidates = device_selection.size() > 8 ? device_selection.substr(8) : "all";
+    cl_device_id fastest = fastest_device(select_devices(candidates), cache_dir, std::min(N, (size_t)4 * 1024 * 1024));
+    std::cout << "Fastest device: " << device_name(fastest) << std::endl;
+    devices.push_back(fastest);
+  } else {
+    devices = select_devices(device_selection);
+  }
+  if (devices.size() > 1) {
+    add_multi_device(devices, cache_dir, N, validation);
+    return 0;
+  }
+  
+  // The engine is set up once and can serve any number of add_opencl calls.
+  OpenCLEngine engine(devices[0], cache_dir, stream_config.out_of_order);
+  const ProgramBuildInfo& build_info = engine.build_info();
+  std::cout << "Program cache " << (build_info.cache_hit ? "hit" : "miss")
+            << ", program ready in " << build_info.seconds << "s" << std::endl;
+  if (stream_config.out_of_order && !engine.out_of_order()) {
+    std::cout << "Out-of-order queues not supported, using in-order" << std::endl;
+  }
+  
+  // --autotune sweeps the kernel configurations and records the winner for
+  // this device and N; later runs pick it up unless told otherwise.
+  std::string tuning_path = cache_dir.empty() ? std::string() : tuning_file_path(cache_dir, devices[0]);
+  TuningConfig tuning;
+  if (tune) {
+    std::vector<TuningResult> results = autotune(engine, N);
+    std::cout << "Autotune results (fastest first):" << std::endl;
+    for (size_t i = 0; i < results.size() && i < 5; i++) {
+      std::cout << "  " << describe(results[i].config) << ": " << results[i].seconds << "s" << std::endl;
+    }
+    if (!tuning_path.empty() && !save_tuning(tuning_path, N, results.front().config)) {
+      std::cout << "Could not write " << tuning_path << std::endl;
+    }
+  } else if (!vector_width && !elements_per_item && !tuning_path.empty() &&
+             load_tuning(tuning_path, N, &tuning) && apply_tuning(engine, tuning)) {
+    std::cout << "Loaded tuning from " << tuning_path << std::endl;
+  }
+  
+  // Without --vector-width the engine follows the device's preferred width.
+  if (vector_width) {
+    AddKernel kernel = preferred_add_kernel(vector_width);
+    if (add_kernel_width(kernel) != vector_width) {
+      throw std::invalid_argument("--vector-width must be 1, 4, 8 or 16");
+    }
+    engine.set_add_kernel(kernel);
+  }
+  
+  // --elements-per-item selects the coarsened grid-stride kernel.
+  if (elements_per_item) {
+    engine.set_elements_per_item(elements_per_item);
+    engine.set_add_kernel(ADD_COARSE);
+  }
+  
+  std::cout << "Kernel: " << add_kernel_name(engine.add_kernel());
+  if (engine.add_kernel() == ADD_COARSE) {
+    std::cout << " (" << engine.elements_per_item() << " elements per item)";
+  }
+  std::cout << ", local size " << engine.local_size() << std::endl;
+  
+  if (size_sweep) {
+    add_size_sweep(engine, N, validation);
+    return 0;
+  }
+  
+  // --benchmark repeats the add at N (or, with --sweep, at sizes from KiB
+  // to GiB) and reports statistics instead of a single cold run.
+  if (benchmark) {
+    benchmark_config.validation = validation;
+    if (sweep) {
+      benchmark_config.sizes = benchmark_sweep_sizes(engine);
+    } else {
+      benchmark_config.sizes.push_back(N);
+    }
+    BenchmarkReport report = run_benchmark(engine, benchmark_config);
+    if (output_path.empty()) {
+      write_benchmark(std::cout, report, format);
+    } else {
+      std::ofstream output(output_path.c_str());
+      write_benchmark(output, report, format);
+      if (!output) {
+        throw std::runtime_error("Could not write " + output_path);
+      }
+    }
+    return 0;
+  }
+  
+  // All three files are needed; the element count comes from the inputs.
+  if (!input_a.empty() || !input_b.empty() || !output_c.empty()) {
+    if (input_a.empty() || input_b.empty() || output_c.empty()) {
+      throw std::invalid_argument("--input-a, --input-b and --output-c go together");
+    }
+    add_mapped_files(engine, input_a, input_b, output_c, stream_config, validation);
+    return 0;
+  }
+  
+  if (fused) {
+    add_fused(engine, N, validation);
+    return 0;
+  }
+  
+  if (reduce) {
+    add_reduce(engine, N, validation);
+    return 0;
+  }
+  
+  // --type runs the type-generic kernel instead of the int kernels above.
+  if (!type.empty()) {
+    if (type == "char") {
+      add_typed<cl_char>(engine, N, saturate, validation);
+    } else if (type == "uchar") {
+      add_typed<cl_uchar>(engine, N, saturate, validation);
+    } else if (type == "short") {
+      add_typed<cl_short>(engine, N, saturate, validation);
+    } else if (type == "ushort") {
+      add_typed<cl_ushort>(engine, N, saturate, validation);
+    } else if (type == "int") {
+      add_typed<cl_int>(engine, N, saturate, validation);
+    } else if (type == "uint") {
+      add_typed<cl_uint>(engine, N, saturate, validation);
+    } else if (type == "long") {
+      add_typed<cl_long>(engine, N, saturate, validation);
+    } else if (type == "ulong") {
+      add_typed<cl_ulong>(engine, N, saturate, validation);
+    } else if (type == "float") {
+      add_typed<cl_float>(engine, N, saturate, validation);
+    } else if (type == "double") {
+      add_typed<cl_double>(engine, N, saturate, validation);
+    } else if (type == "half") {
+      add_typed<Half>(engine, N, saturate, validation);
+    } else {
+      throw std::invalid_argument("--type must be char, uchar, short, ushort, int, uint, long, ulong, float, double or half");
+    }
+    return 0;
+  }
+  
+  if (threads) {
+    add_concurrent(engine, N, threads, validation);
+    return 0;
+  }
+  
+  if (batch) {
+    add_batched(engine, batch_jobs, batcher_config, validation);
+    return 0;
   }
   
-  double opencl_time = add_opencl(use_gpu, c, b, a, N);
-  std::cout << "OpenCL execution time: " << opencl_time << "s" << std::endl;
+  // --queue-modes streams N elements on in-order and out-of-order queues,
+  // one and several, to pick the arrangement for this device.
+  if (queue_modes) {
+    benchmark_config.validation = validation;
+    std::vector<QueueModeResult> results = compare_queue_modes(engine, N, stream_config, benchmark_config);
+    if (output_path.empty()) {
+      write_queue_modes(std::cout, device_name(devices[0]), results, format);
+    } else {
+      std::ofstream output(output_path.c_str());
+      write_queue_modes(output, device_name(devices[0]), results, format);
+      if (!output) {
+        throw std::runtime_error("Could not write " + output_path);
+      }
+    }
+    return 0;
+  }
+  
+  // --compare-native times the host SIMD baseline against the device over
+  // the whole sweep and reports where offloading starts to pay off.
+  if (compare) {
+    benchmark_config.validation = validation;
+    benchmark_config.sizes = benchmark_sweep_sizes(engine);
+    std::vector<NativeComparison> comparisons = compare_native(engine, benchmark_config);
+    if (output_path.empty()) {
+      write_comparison(std::cout, device_name(devices[0]), comparisons, format);
+    } else {
+      std::ofstream output(output_path.c_str());
+      write_comparison(output, device_name(devices[0]), comparisons, format);
+      if (!output) {
+        throw std::runtime_error("Could not write " + output_path);
+      }
+    }
+    return 0;
+  }
+  
+  // Allocate and initialize the data sets for the kernel. The arrays are
+  // aligned for the device so --zero-copy can use them in place, and come
+  // pre-faulted from the arena so the timings below exclude first touch.
+  HostArena& arena = host_arena();
+  int* a = (int*)arena.acquire(sizeof(int) * N, engine.host_alignment());
+  int* b = (int*)arena.acquire(sizeof(int) * N, engine.host_alignment());
+  int* c = (int*)arena.acquire(sizeof(int) * N, engine.host_alignment());
+  
+  if (stream) {
+    uint64_t checksum = fill_operands(a, b, 0, N);
+    
+    StreamResult result = stream_add(engine, c, b, a, N, stream_config);
+    validate_add(c, b, a, N, checksum, validation);
+    std::cout << "OpenCL streaming time (" << result.chunks << " chunks, depth " << stream_config.depth
+              << ", " << stream_config.queues << " queues): " << result.seconds << "s, "
+              << result.gigabytes_per_second << " GB/s" << std::endl;
+  } else if (async) {
+    // Inputs are initialized batch by batch, overlapping with the device.
+    double async_time = add_opencl_async(engine, c, b, a, N, 8, validation);
+    std::cout << "OpenCL async total time (8 batches): " << async_time << "s" << std::endl;
+  } else {
+    uint64_t checksum = fill_operands(a, b, 0, N);
+    
+    // The total includes transfers (or mapping), which is what differs
+    // between the copy and zero-copy paths.
+    Timer total_timer;
+    AddProfile profile;
+    total_timer.start();
+    double opencl_time = add_opencl(engine, c, b, a, N, zero_copy, checksum, validation, &profile);
+    total_timer.stop();
+    std::cout << "OpenCL execution time" << (zero_copy ? " (zero-copy)" : "") << ": "
+              << opencl_time << "s" << std::endl;
+    std::cout << "Total time including transfers: " << total_timer.elapsed() << "s" << std::endl;
+    print_profile(profile);
+  }
+  
+  const BufferPoolStats& pool_stats = engine.pool_stats();
+  std::cout << "Buffer pool: " << pool_stats.hits << " hits, " << pool_stats.misses << " misses, "
+            << pool_stats.bytes_resident << " bytes resident, "
+            << pool_stats.high_water << " bytes high-water" << std::endl;
+  
+  const HostArenaStats& arena_stats = arena.stats();
+  std::cout << "Host arena: " << arena_stats.blocks << " blocks mapped, " << arena_stats.reuses << " reused, "
+            << arena_stats.bytes_mapped << " bytes (" << arena_stats.huge_page_advised_bytes << " advised huge pages), "
+            << arena_stats.first_touch_seconds << "s first touch" << std::endl;
   
-  delete [] c;
-  delete [] b;
-  delete [] a;
+  arena.release(c);
+  arena.release(b);
+  arena.release(a);
   
   return 0;
 }
@@ -0,0 +1,81 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+// Type-generic c = a + b, built once per element type by OpenCLEngine with
+// -DT=<type> (see typed_add.h). Optional build options:
+//   -DSATURATE      clamp integer sums with add_sat() instead of wrapping
+//   -DUSE_FP64      enable cl_khr_fp64 for T=double
+//   -DHALF_STORAGE  T=half: the arrays hold 16-bit floats, widened to float
+//                   with vload_half so no cl_khr_fp16 support is needed
+#ifndef T
+#define T int
+#endif
+
+#ifdef USE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#define CAT(x, y) x##y
+#define VECTOR(type, width) CAT(type, width)
+
+#ifdef SATURATE
+#define ADD(x, y) add_sat(x, y)
+#else
+#define ADD(x, y) ((x) + (y))
+#endif
+
+// Each work-item adds four consecutive elements; the work-item just past the
+// last full vector handles the n % 4 tail, as in add_int4.
+#ifdef HALF_STORAGE
+__kernel void add_typed(__global half* c, __global const half* a, __global const half* b, const uint n)
+{
+   uint i = get_global_id(0);
+   uint vectors = n / 4;
+   if (i < vectors) {
+      vstore_half4(vload_half4(i, a) + vload_half4(i, b), i, c);
+   } else if (i == vectors) {
+      for (uint j = i * 4; j < n; j++) {
+         vstore_half(vload_half(j, a) + vload_half(j, b), j, c);
+      }
+   }
+}
+#else
+__kernel void add_typed(__global T* c, __global const T* a, __global const T* b, const uint n)
+{
+   uint i = get_global_id(0);
+   uint vectors = n / 4;
+   if (i < vectors) {
+      VECTOR(T, 4) x = vload4(i, a);
+      VECTOR(T, 4) y = vload4(i, b);
+      vstore4(ADD(x, y), i, c);
+   } else if (i == vectors) {
+      for (uint j = i * 4; j < n; j++) {
+         c[j] = ADD(a[j], b[j]);
+      }
+   }
+}
+#endif
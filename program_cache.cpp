@@ -0,0 +1,230 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "program_cache.h"
+#include "cl_handle.h"
+#include "devices.h"
+#include "timer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+cl_program build_from_source(cl_context context, cl_device_id device, const std::string& source, const std::string& options)
+{
+  cl_int err = CL_SUCCESS;
+  const char* source_cstr = source.c_str();
+
+  // Create a program from the source buffer.
+  ProgramHandle program(clCreateProgramWithSource(context, 1, (const char **)&source_cstr, NULL, &err));
+  if (!program) {
+    throw OpenCLError("clCreateProgramWithSource", err);
+  }
+
+  // Build the program. On failure the compiler's log is the only useful
+  // diagnostic, so it travels with the exception.
+  err = clBuildProgram(program.get(), 1, &device, options.c_str(), NULL, NULL);
+  if (err != CL_SUCCESS) {
+    throw ProgramBuildError(err, program_build_log(program.get(), device));
+  }
+  return program.release();
+}
+
+} // namespace
+
+bool make_directories(const std::string& directory)
+{
+  for (size_t pos = directory.find('/', 1); ; pos = directory.find('/', pos + 1)) {
+    std::string prefix = directory.substr(0, pos);
+    if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+      return false;
+    }
+    if (pos == std::string::npos) {
+      return true;
+    }
+  }
+}
+
+std::string temp_file_path(const std::string& path)
+{
+  static std::atomic<unsigned long> counter(0);
+  std::ostringstream temp;
+  temp << path << ".tmp." << getpid() << "." << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id())
+       << "." << counter++;
+  return temp.str();
+}
+
+unsigned long long fnv1a_hash(const std::string& data)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < data.size(); i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+ProgramCache::ProgramCache(const std::string& directory)
+: m_directory(directory)
+{
+}
+
+ProgramCache::~ProgramCache()
+{
+}
+
+std::string ProgramCache::key(cl_device_id device, const std::string& source, const std::string& options) const
+{
+  std::ostringstream key;
+  key << "device=" << device_string(device, CL_DEVICE_NAME)
+      << ";driver=" << device_string(device, CL_DRIVER_VERSION)
+      << ";options=" << options
+      << ";source=" << std::hex << fnv1a_hash(source);
+  return key.str();
+}
+
+std::string ProgramCache::path(const std::string& key) const
+{
+  std::ostringstream path;
+  path << m_directory << "/" << std::hex << fnv1a_hash(key) << ".bin";
+  return path.str();
+}
+
+cl_program ProgramCache::load(cl_context context, cl_device_id device, const std::string& key, const std::string& options) const
+{
+  std::ifstream file(path(key).c_str(), std::ios::binary);
+  if (!file) {
+    return NULL;
+  }
+
+  // The first line holds the full key so that a hash collision is treated
+  // as a miss rather than loading the wrong binary.
+  std::string stored_key;
+  if (!std::getline(file, stored_key) || stored_key != key) {
+    return NULL;
+  }
+  std::vector<unsigned char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (binary.empty()) {
+    return NULL;
+  }
+
+  size_t size = binary.size();
+  const unsigned char* data = &binary[0];
+  cl_int status = CL_SUCCESS;
+  cl_int err = CL_SUCCESS;
+  ProgramHandle program(clCreateProgramWithBinary(context, 1, &device, &size, &data, &status, &err));
+  if (!program || err != CL_SUCCESS || status != CL_SUCCESS) {
+    return NULL;
+  }
+
+  // Binaries still have to be "built", which is cheap compared to compiling.
+  if (clBuildProgram(program.get(), 1, &device, options.c_str(), NULL, NULL) != CL_SUCCESS) {
+    return NULL;
+  }
+  return program.release();
+}
+
+bool ProgramCache::store(cl_program program, const std::string& key) const
+{
+  size_t size = 0;
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS || size == 0) {
+    return false;
+  }
+  std::vector<unsigned char> binary(size);
+  unsigned char* data = &binary[0];
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, NULL) != CL_SUCCESS) {
+    return false;
+  }
+  if (!make_directories(m_directory)) {
+    return false;
+  }
+
+  // Write to a temporary file and rename it into place so that concurrent
+  // runs never see a partially written entry.
+  std::string final_path = path(key);
+  std::string temp_path = temp_file_path(final_path);
+  {
+    std::ofstream file(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+    file << key << '\n';
+    file.write((const char*)data, size);
+    // Buffered data only reaches the file on close, so a short write
+    // (e.g. a full disk) shows up there and not before.
+    file.close();
+    if (file.fail()) {
+      remove(temp_path.c_str());
+      return false;
+    }
+  }
+  if (rename(temp_path.c_str(), final_path.c_str()) != 0) {
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+cl_program ProgramCache::build(cl_context context, cl_device_id device, const std::string& source,
+                               const std::string& options, ProgramBuildInfo* info) const
+{
+  Timer build_timer;
+  build_timer.start();
+
+  std::string cache_key;
+  ProgramHandle program;
+  if (!m_directory.empty()) {
+    cache_key = key(device, source, options);
+    program.reset(load(context, device, cache_key, options));
+  }
+
+  bool cache_hit = (bool)program;
+  if (!cache_hit) {
+    program.reset(build_from_source(context, device, source, options));
+    // A cache that can't be written (read-only directory, full disk) only
+    // costs a rebuild on the next run, so it isn't treated as an error.
+    if (!m_directory.empty()) {
+      store(program.get(), cache_key);
+    }
+  }
+
+  build_timer.stop();
+  if (info) {
+    info->cache_hit = cache_hit;
+    info->seconds = build_timer.elapsed();
+  }
+  return program.release();
+}
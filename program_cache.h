@@ -0,0 +1,80 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef PROGRAM_CACHE_H__
+#define PROGRAM_CACHE_H__
+
+#include <string>
+#include <OpenCL/opencl.h>
+
+// Outcome of ProgramCache::build(), reported back to the caller.
+struct ProgramBuildInfo {
+    bool    cache_hit;
+    double  seconds;
+
+    ProgramBuildInfo() : cache_hit(false), seconds(0.0) {}
+};
+
+// Stores program binaries from clGetProgramInfo(CL_PROGRAM_BINARIES) in a
+// directory so that later runs can skip compiling from source. An entry is
+// keyed by the device name, driver version, build options and a hash of the
+// kernel source; any change to those forces a rebuild from source.
+class ProgramCache {
+protected:
+    std::string m_directory;
+
+    std::string key(cl_device_id device, const std::string& source, const std::string& options) const;
+    std::string path(const std::string& key) const;
+
+    cl_program load(cl_context context, cl_device_id device, const std::string& key, const std::string& options) const;
+    bool store(cl_program program, const std::string& key) const;
+
+public:
+    // An empty directory disables the cache and always builds from source.
+    explicit ProgramCache(const std::string& directory);
+    ~ProgramCache();
+
+    const std::string& directory() const { return m_directory; }
+
+    // Returns a built program for `source`, loading it from the cache when
+    // the key matches and building (then storing) it otherwise.
+    cl_program build(cl_context context, cl_device_id device, const std::string& source,
+                     const std::string& options, ProgramBuildInfo* info = NULL) const;
+};
+
+// 64-bit FNV-1a hash, used for cache keys.
+unsigned long long fnv1a_hash(const std::string& data);
+
+// Creates `directory` and any missing parents; false on failure.
+bool make_directories(const std::string& directory);
+
+// A name next to `path` for writing a file before renaming it into place,
+// unique to this process, thread and call, so concurrent writers of the
+// same file never share (and truncate) one temporary.
+std::string temp_file_path(const std::string& path);
+
+#endif // PROGRAM_CACHE_H__
@@ -0,0 +1,238 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "reduce.h"
+#include "cl_handle.h"
+#include "opencl_engine.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// First-stage work groups per compute unit; enough to hide memory latency
+// while keeping the second stage to a handful of partials.
+static const size_t kGroupsPerComputeUnit = 8;
+
+// Local memory for the tree is local size * 8 bytes, so more than this
+// buys nothing but occupancy loss.
+static const size_t kMaxReduceLocalSize = 256;
+
+namespace {
+
+const char* reduce_kernel_name(ReduceKernel kernel)
+{
+  static const char* names[REDUCE_KERNEL_COUNT] = {
+    "reduce_sum", "reduce_sum_long", "reduce_min", "reduce_max", "reduce_dot", "add_sum"
+  };
+  return names[kernel];
+}
+
+bool two_inputs(ReduceKernel kernel)
+{
+  return kernel == REDUCE_DOT || kernel == REDUCE_ADD_SUM;
+}
+
+// Uploads host arrays for the host-pointer overloads and returns the
+// buffers to the pool afterwards. The reduction waits on `events`, the
+// writes, so it is ordered after them on any queue.
+struct Uploaded {
+    PooledBuffer    buffers[2];
+    EventHandle     writes[2];
+    cl_event        events[2];      // writes[i].get(), as a wait list
+    cl_uint         count;
+    QueueFinish     finish;         // destroyed first
+
+    Uploaded(OpenCLEngine& engine, const int* a, const int* b, size_t N)
+    : count(0)
+    , finish(engine.queue())
+    {
+      const int* inputs[2] = { a, b };
+      for (size_t i = 0; i < 2 && inputs[i]; i++) {
+        buffers[i] = PooledBuffer(engine.pool(), sizeof(int) * N, CL_MEM_READ_ONLY);
+        check_cl(clEnqueueWriteBuffer(engine.queue(), buffers[i].get(), CL_FALSE, 0, sizeof(int) * N, inputs[i],
+                                      0, NULL, writes[i].out()), "clEnqueueWriteBuffer");
+        events[i] = writes[i].get();
+        count++;
+      }
+    }
+};
+
+} // namespace
+
+Reducer::Reducer(OpenCLEngine& engine)
+: m_engine(engine)
+, m_local_size(kMaxReduceLocalSize)
+, m_max_groups(std::max((size_t)engine.compute_units(), (size_t)1) * kGroupsPerComputeUnit)
+{
+  for (size_t i = 0; i < REDUCE_KERNEL_COUNT; i++) {
+    m_kernels[i].reset(engine.create_kernel(reduce_kernel_name((ReduceKernel)i)));
+
+    size_t max_local_size = 0;
+    check_cl(clGetKernelWorkGroupInfo(m_kernels[i].get(), engine.device(), CL_KERNEL_WORK_GROUP_SIZE,
+                                      sizeof(max_local_size), &max_local_size, NULL), "clGetKernelWorkGroupInfo");
+    while (m_local_size > max_local_size && m_local_size > 1) {
+      m_local_size /= 2;
+    }
+  }
+}
+
+void Reducer::reduce(ReduceKernel first, ReduceKernel second, cl_mem a, cl_mem b, size_t N,
+                     size_t value_size, void* result, cl_uint num_events, const cl_event* wait_list)
+{
+  if (N > CL_UINT_MAX) {
+    throw std::invalid_argument("Reducer: N exceeds 32-bit kernel indexing");
+  }
+
+  BufferPool& pool = m_engine.pool();
+  cl_command_queue queue = m_engine.queue();
+  size_t groups = std::max((size_t)1, std::min(m_max_groups, (N + m_local_size - 1) / m_local_size));
+  PooledBuffer partials(pool, groups * value_size, CL_MEM_READ_WRITE);
+  PooledBuffer final_value(pool, value_size, CL_MEM_WRITE_ONLY);
+  EventHandle stages[2];
+  QueueFinish finish(queue);
+  cl_mem partials_buffer = partials.get();
+  cl_mem final_buffer = final_value.get();
+
+  // Stage one: one partial per work group.
+  cl_kernel kernel = m_kernels[first].get();
+  cl_uint arg = 0;
+  cl_uint n = (cl_uint)N;
+  cl_int err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &a);
+  if (two_inputs(first)) {
+    err |= clSetKernelArg(kernel, arg++, sizeof(cl_mem), &b);
+  }
+  err |= clSetKernelArg(kernel, arg++, sizeof(cl_mem), &partials_buffer);
+  err |= clSetKernelArg(kernel, arg++, m_local_size * value_size, NULL);
+  err |= clSetKernelArg(kernel, arg++, sizeof(cl_uint), &n);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clSetKernelArg", err);
+  }
+  size_t global_size = groups * m_local_size;
+  check_cl(clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, &m_local_size, num_events, wait_list,
+                                  stages[0].out()), "clEnqueueNDRangeKernel");
+
+  // Stage two: a single work group folds the partials. Each step waits
+  // on the previous one's event, as the queue may be out of order.
+  kernel = m_kernels[second].get();
+  cl_uint partial_count = (cl_uint)groups;
+  err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &partials_buffer);
+  err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &final_buffer);
+  err |= clSetKernelArg(kernel, 2, m_local_size * value_size, NULL);
+  err |= clSetKernelArg(kernel, 3, sizeof(cl_uint), &partial_count);
+  if (err != CL_SUCCESS) {
+    throw OpenCLError("clSetKernelArg", err);
+  }
+  cl_event stage_one = stages[0].get();
+  check_cl(clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &m_local_size, &m_local_size, 1, &stage_one,
+                                  stages[1].out()), "clEnqueueNDRangeKernel");
+
+  cl_event stage_two = stages[1].get();
+  check_cl(clEnqueueReadBuffer(queue, final_buffer, CL_TRUE, 0, value_size, result, 1, &stage_two, NULL),
+           "clEnqueueReadBuffer");
+}
+
+int64_t Reducer::sum(cl_mem in, size_t N, cl_uint num_events, const cl_event* wait_list)
+{
+  cl_long result = 0;
+  reduce(REDUCE_SUM, REDUCE_SUM_LONG, in, NULL, N, sizeof(result), &result, num_events, wait_list);
+  return result;
+}
+
+cl_int Reducer::min(cl_mem in, size_t N, cl_uint num_events, const cl_event* wait_list)
+{
+  cl_int result = 0;
+  reduce(REDUCE_MIN, REDUCE_MIN, in, NULL, N, sizeof(result), &result, num_events, wait_list);
+  return result;
+}
+
+cl_int Reducer::max(cl_mem in, size_t N, cl_uint num_events, const cl_event* wait_list)
+{
+  cl_int result = 0;
+  reduce(REDUCE_MAX, REDUCE_MAX, in, NULL, N, sizeof(result), &result, num_events, wait_list);
+  return result;
+}
+
+int64_t Reducer::dot(cl_mem a, cl_mem b, size_t N, cl_uint num_events, const cl_event* wait_list)
+{
+  cl_long result = 0;
+  reduce(REDUCE_DOT, REDUCE_SUM_LONG, a, b, N, sizeof(result), &result, num_events, wait_list);
+  return result;
+}
+
+int64_t Reducer::add_sum(cl_mem a, cl_mem b, size_t N, cl_uint num_events, const cl_event* wait_list)
+{
+  cl_long result = 0;
+  reduce(REDUCE_ADD_SUM, REDUCE_SUM_LONG, a, b, N, sizeof(result), &result, num_events, wait_list);
+  return result;
+}
+
+// Zero-byte writes are invalid, so empty host arrays go straight to the
+// identity values.
+
+int64_t Reducer::sum(const int* in, size_t N)
+{
+  if (N == 0) {
+    return 0;
+  }
+  Uploaded uploaded(m_engine, in, NULL, N);
+  return sum(uploaded.buffers[0].get(), N, uploaded.count, uploaded.events);
+}
+
+cl_int Reducer::min(const int* in, size_t N)
+{
+  if (N == 0) {
+    return CL_INT_MAX;
+  }
+  Uploaded uploaded(m_engine, in, NULL, N);
+  return min(uploaded.buffers[0].get(), N, uploaded.count, uploaded.events);
+}
+
+cl_int Reducer::max(const int* in, size_t N)
+{
+  if (N == 0) {
+    return CL_INT_MIN;
+  }
+  Uploaded uploaded(m_engine, in, NULL, N);
+  return max(uploaded.buffers[0].get(), N, uploaded.count, uploaded.events);
+}
+
+int64_t Reducer::dot(const int* a, const int* b, size_t N)
+{
+  if (N == 0) {
+    return 0;
+  }
+  Uploaded uploaded(m_engine, a, b, N);
+  return dot(uploaded.buffers[0].get(), uploaded.buffers[1].get(), N, uploaded.count, uploaded.events);
+}
+
+int64_t Reducer::add_sum(const int* a, const int* b, size_t N)
+{
+  if (N == 0) {
+    return 0;
+  }
+  Uploaded uploaded(m_engine, a, b, N);
+  return add_sum(uploaded.buffers[0].get(), uploaded.buffers[1].get(), N, uploaded.count, uploaded.events);
+}
@@ -0,0 +1,94 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef REDUCE_H__
+#define REDUCE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <OpenCL/opencl.h>
+
+#include "cl_handle.h"
+
+class OpenCLEngine;
+
+// The reduction kernels in opencl_example.cl.
+enum ReduceKernel {
+    REDUCE_SUM,         // reduce_sum: int -> long partials
+    REDUCE_SUM_LONG,    // reduce_sum_long: second stage for the sums
+    REDUCE_MIN,         // reduce_min: int -> int, its own second stage
+    REDUCE_MAX,         // reduce_max
+    REDUCE_DOT,         // reduce_dot: a . b -> long partials
+    REDUCE_ADD_SUM,     // add_sum: sum of a + b without storing c
+    REDUCE_KERNEL_COUNT
+};
+
+// Sum, min, max and dot product over int arrays on the device, two-stage:
+// a first launch leaves one partial per work group and a second,
+// single-group launch reduces those, so only the final value is read back.
+// Uses the engine's queue, program and buffer pool.
+class Reducer {
+protected:
+    OpenCLEngine&   m_engine;
+    KernelHandle    m_kernels[REDUCE_KERNEL_COUNT];
+    size_t          m_local_size;   // power of two that every kernel supports
+    size_t          m_max_groups;   // first-stage work groups
+
+    void reduce(ReduceKernel first, ReduceKernel second, cl_mem a, cl_mem b, size_t N,
+                size_t value_size, void* result, cl_uint num_events, const cl_event* wait_list);
+
+private:
+    Reducer(const Reducer&);
+    Reducer& operator=(const Reducer&);
+
+public:
+    explicit Reducer(OpenCLEngine& engine);
+
+    size_t local_size() const { return m_local_size; }
+
+    // Over N ints already on the device, e.g. results left there by an
+    // earlier kernel. The first launch waits for `wait_list`, which is how
+    // to order it after the commands producing the input when the engine's
+    // queue is out of order.
+    int64_t sum(cl_mem in, size_t N, cl_uint num_events = 0, const cl_event* wait_list = NULL);
+    cl_int min(cl_mem in, size_t N, cl_uint num_events = 0, const cl_event* wait_list = NULL);   // CL_INT_MAX when N == 0
+    cl_int max(cl_mem in, size_t N, cl_uint num_events = 0, const cl_event* wait_list = NULL);   // CL_INT_MIN when N == 0
+    int64_t dot(cl_mem a, cl_mem b, size_t N, cl_uint num_events = 0, const cl_event* wait_list = NULL);
+
+    // The sum of c = a + b fused into one pass: c is never written, so
+    // only the final 8 bytes come back instead of all of c.
+    int64_t add_sum(cl_mem a, cl_mem b, size_t N, cl_uint num_events = 0, const cl_event* wait_list = NULL);
+
+    // The same over host arrays, which are uploaded to pooled buffers.
+    int64_t sum(const int* in, size_t N);
+    cl_int min(const int* in, size_t N);
+    cl_int max(const int* in, size_t N);
+    int64_t dot(const int* a, const int* b, size_t N);
+    int64_t add_sum(const int* a, const int* b, size_t N);
+};
+
+#endif // REDUCE_H__
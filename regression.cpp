@@ -0,0 +1,257 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+#include "regression.h"
+#include "program_cache.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+namespace {
+
+// Continued fraction of the incomplete beta function, by the modified
+// Lentz method; converges quickly for x < (a + 1) / (a + b + 2).
+double beta_continued_fraction(double a, double b, double x)
+{
+  const double tiny = 1e-300;
+  double c = 1.0;
+  double d = 1.0 - (a + b) * x / (a + 1.0);
+  d = 1.0 / (fabs(d) < tiny ? tiny : d);
+  double h = d;
+  for (int m = 1; m <= 200; m++) {
+    // Even step, then odd step.
+    double numerator = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+    d = 1.0 + numerator * d;
+    c = 1.0 + numerator / c;
+    d = 1.0 / (fabs(d) < tiny ? tiny : d);
+    c = fabs(c) < tiny ? tiny : c;
+    h *= d * c;
+
+    numerator = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+    d = 1.0 + numerator * d;
+    c = 1.0 + numerator / c;
+    d = 1.0 / (fabs(d) < tiny ? tiny : d);
+    c = fabs(c) < tiny ? tiny : c;
+    double delta = d * c;
+    h *= delta;
+    if (fabs(delta - 1.0) < 1e-12) {
+      break;
+    }
+  }
+  return h;
+}
+
+// The regularized incomplete beta function I_x(a, b).
+double regularized_beta(double a, double b, double x)
+{
+  if (x <= 0.0) {
+    return 0.0;
+  }
+  if (x >= 1.0) {
+    return 1.0;
+  }
+  double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1.0 - x));
+  if (x < (a + 1.0) / (a + b + 2.0)) {
+    return front * beta_continued_fraction(a, b, x) / a;
+  }
+  return 1.0 - front * beta_continued_fraction(b, a, 1.0 - x) / b;
+}
+
+// P(T > t) for Student's t distribution with `df` degrees of freedom.
+double student_t_upper_tail(double t, double df)
+{
+  double tail = 0.5 * regularized_beta(0.5 * df, 0.5, df / (df + t * t));
+  return t > 0.0 ? tail : 1.0 - tail;
+}
+
+} // namespace
+
+std::string baseline_file_path(const std::string& directory, const std::string& device)
+{
+  std::ostringstream path;
+  path << directory << "/baseline-" << std::hex << fnv1a_hash(device) << ".txt";
+  return path.str();
+}
+
+bool save_baseline(const std::string& path, const std::string& device, const std::string& driver,
+                   const std::vector<SuiteResult>& results)
+{
+  size_t slash = path.rfind('/');
+  if (slash != std::string::npos && slash > 0 && !make_directories(path.substr(0, slash))) {
+    return false;
+  }
+
+  // The two header lines only tell readers which device the file is for.
+  std::string temp_path = temp_file_path(path);
+  {
+    std::ofstream out(temp_path.c_str(), std::ios::trunc);
+    out << "# device " << device << "\n"
+        << "# driver " << driver << "\n"
+        << std::setprecision(9);
+    for (size_t i = 0; i < results.size(); i++) {
+      const SuiteResult& r = results[i];
+      out << r.name() << " " << r.seconds.count() << " " << r.seconds.median() << " "
+          << r.seconds.mean() << " " << r.seconds.stddev() << "\n";
+    }
+    // Buffered data only reaches the file on close, so a short write
+    // (e.g. a full disk) shows up there and not before.
+    out.close();
+    if (out.fail()) {
+      remove(temp_path.c_str());
+      return false;
+    }
+  }
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool load_baseline(const std::string& path, Baseline* baseline)
+{
+  std::ifstream in(path.c_str());
+  Baseline loaded;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 9, "# device ") == 0) {
+      loaded.device = line.substr(9);
+      continue;
+    }
+    if (line.compare(0, 9, "# driver ") == 0) {
+      loaded.driver = line.substr(9);
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string name;
+    BaselineEntry entry;
+    if (fields >> name >> entry.samples >> entry.median >> entry.mean >> entry.stddev && name[0] != '#') {
+      loaded.entries[name] = entry;
+    }
+  }
+  if (loaded.entries.empty()) {
+    return false;
+  }
+  *baseline = loaded;
+  return true;
+}
+
+double welch_p_value(size_t n1, double mean1, double stddev1, size_t n2, double mean2, double stddev2)
+{
+  if (n1 < 2 || n2 < 2) {
+    return 1.0;
+  }
+  double v1 = stddev1 * stddev1 / n1;
+  double v2 = stddev2 * stddev2 / n2;
+  if (v1 + v2 <= 0.0) {
+    // No spread at all: the means either differ or they don't.
+    return mean1 > mean2 ? 0.0 : 1.0;
+  }
+
+  // Welch-Satterthwaite degrees of freedom.
+  double t = (mean1 - mean2) / sqrt(v1 + v2);
+  double df = (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+  return student_t_upper_tail(t, df);
+}
+
+std::vector<CaseComparison> compare_to_baseline(const std::vector<SuiteResult>& results, const Baseline& baseline,
+                                                const RegressionOptions& options)
+{
+  std::vector<CaseComparison> comparisons;
+  for (size_t i = 0; i < results.size(); i++) {
+    const SuiteResult& r = results[i];
+    CaseComparison comparison;
+    comparison.name = r.name();
+    comparison.median = r.seconds.median();
+    comparison.in_baseline = false;
+    comparison.baseline_median = 0.0;
+    comparison.change = 0.0;
+    comparison.p_slower = 1.0;
+    comparison.p_faster = 1.0;
+    comparison.regression = false;
+    comparison.improvement = false;
+
+    std::map<std::string, BaselineEntry>::const_iterator found = baseline.entries.find(comparison.name);
+    if (found != baseline.entries.end() && found->second.median > 0.0) {
+      const BaselineEntry& base = found->second;
+      size_t n = r.seconds.count();
+      double mean = r.seconds.mean();
+      double stddev = n > 1 ? r.seconds.stddev() : 0.0;
+      comparison.in_baseline = true;
+      comparison.baseline_median = base.median;
+      comparison.change = comparison.median / base.median - 1.0;
+      comparison.p_slower = welch_p_value(n, mean, stddev, base.samples, base.mean, base.stddev);
+      comparison.p_faster = welch_p_value(base.samples, base.mean, base.stddev, n, mean, stddev);
+      comparison.regression = comparison.change >= options.min_change && comparison.p_slower < options.alpha;
+      comparison.improvement = comparison.change <= -options.min_change && comparison.p_faster < options.alpha;
+    }
+    comparisons.push_back(comparison);
+  }
+  return comparisons;
+}
+
+size_t count_regressions(const std::vector<CaseComparison>& comparisons)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < comparisons.size(); i++) {
+    if (comparisons[i].regression) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void write_suite(std::ostream& out, const std::string& device, const std::vector<SuiteResult>& results,
+                 const std::vector<CaseComparison>& comparisons)
+{
+  out << device << ": " << results.size() << " cases (median of "
+      << (results.empty() ? 0 : results[0].seconds.count()) << " runs)\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const SuiteResult& r = results[i];
+    out << std::left << std::setw(32) << r.name() << std::right
+        << std::setw(12) << r.seconds.median() * 1e3 << "ms"
+        << " " << std::setw(10) << r.gbps() << " GB/s";
+    if (i < comparisons.size()) {
+      const CaseComparison& c = comparisons[i];
+      if (!c.in_baseline) {
+        out << "  new";
+      } else {
+        out << std::showpos << std::setw(9) << c.change * 100.0 << "%" << std::noshowpos;
+        if (c.regression) {
+          out << "  REGRESSION (p = " << c.p_slower << ")";
+        } else if (c.improvement) {
+          out << "  faster (p = " << c.p_faster << ")";
+        }
+      }
+    }
+    out << "\n";
+  }
+  out.flush();
+}
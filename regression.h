@@ -0,0 +1,106 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+#ifndef REGRESSION_H__
+#define REGRESSION_H__
+
+#include <stddef.h>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+
+// Summary statistics of one stored suite case; enough to compare new
+// samples against without keeping the old ones.
+struct BaselineEntry {
+    size_t  samples;
+    double  median;
+    double  mean;
+    double  stddev;
+};
+
+// Stored suite results for one device, keyed by SuiteResult::name().
+struct Baseline {
+    std::string                             device;
+    std::string                             driver;
+    std::map<std::string, BaselineEntry>    entries;
+};
+
+// Results file for `device` (a device_key(), or several joined for the
+// multi-device path) inside `directory`. The key includes the device's
+// index and vendor id, so identical devices get files of their own. Unlike
+// the tuning files, the name ignores the driver version, so a driver
+// update is compared against the results of the previous driver.
+std::string baseline_file_path(const std::string& directory, const std::string& device);
+
+// Writes `results` as the baseline of `device`, replacing the file. Returns
+// false if it can't be written.
+bool save_baseline(const std::string& path, const std::string& device, const std::string& driver,
+                   const std::vector<SuiteResult>& results);
+
+// Returns false if the file doesn't exist or holds no entries.
+bool load_baseline(const std::string& path, Baseline* baseline);
+
+// One-sided p-value of Welch's t-test for the hypothesis that the first
+// sample's mean is larger than the second's. 1 if either sample has fewer
+// than two values.
+double welch_p_value(size_t n1, double mean1, double stddev1, size_t n2, double mean2, double stddev2);
+
+struct RegressionOptions {
+    double  alpha;          // significance level of the t-test
+    double  min_change;     // smallest relative median change worth flagging
+
+    RegressionOptions() : alpha(0.01), min_change(0.05) {}
+};
+
+struct CaseComparison {
+    std::string name;
+    bool        in_baseline;
+    double      median;             // seconds
+    double      baseline_median;    // seconds; 0 if not in the baseline
+    double      change;             // median / baseline_median - 1
+    double      p_slower;           // welch_p_value(current, baseline)
+    double      p_faster;           // welch_p_value(baseline, current)
+    bool        regression;
+    bool        improvement;
+};
+
+// A case regressed when it is slower by at least options.min_change and
+// the t-test says so at options.alpha; improvements likewise the other
+// way. Cases missing from the baseline are reported but never flagged.
+std::vector<CaseComparison> compare_to_baseline(const std::vector<SuiteResult>& results, const Baseline& baseline,
+                                                const RegressionOptions& options);
+
+size_t count_regressions(const std::vector<CaseComparison>& comparisons);
+
+// One line per case with its median, bandwidth and, where there is a
+// baseline, the change and verdict. `comparisons` may be empty.
+void write_suite(std::ostream& out, const std::string& device, const std::vector<SuiteResult>& results,
+                 const std::vector<CaseComparison>& comparisons);
+
+#endif // REGRESSION_H__
@@ -0,0 +1,278 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "stream_add.h"
+#include "cl_handle.h"
+#include "opencl_engine.h"
+#include "timer.h"
+#include "trace.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Device buffers for one chunk, plus the event that has to complete before
+// they can be overwritten by a later chunk.
+struct BufferSet {
+    PooledBuffer    a;
+    PooledBuffer    b;
+    PooledBuffer    c;
+    EventHandle     done;
+};
+
+// Drains every queue when destroyed. Declared after everything the queues'
+// commands use, so all of it outlives the commands on any exit.
+class FinishQueues {
+protected:
+    const std::vector<QueueHandle>& m_queues;
+
+public:
+    explicit FinishQueues(const std::vector<QueueHandle>& queues) : m_queues(queues) {}
+    ~FinishQueues() { finish(); }
+
+    FinishQueues(const FinishQueues&) = delete;
+    FinishQueues& operator=(const FinishQueues&) = delete;
+
+    void finish() const
+    {
+      for (size_t i = 0; i < m_queues.size(); i++) {
+        clFinish(m_queues[i].get());
+      }
+    }
+};
+
+// While tracing, every chunk's events are retained until the stream has
+// drained and only then recorded, so that the trace shows how the queues
+// overlapped. Does nothing when tracing is off.
+class TracedEvents {
+protected:
+    std::vector<std::pair<const char*, EventHandle> > m_events;
+
+public:
+    void keep(const char* name, cl_event event)
+    {
+      if (event && trace().enabled()) {
+        clRetainEvent(event);
+        m_events.push_back(std::make_pair(name, EventHandle(event)));
+      }
+    }
+
+    void record() const
+    {
+      for (size_t i = 0; i < m_events.size(); i++) {
+        const char* name = m_events[i].first;
+        trace().device_span(name, strcmp(name, "kernel") == 0 ? "kernel" : "transfer", m_events[i].second.get());
+      }
+    }
+};
+
+// Queues need profiling for their events to show up in the trace.
+cl_command_queue_properties stream_queue_properties(const OpenCLEngine& engine, const StreamConfig& config)
+{
+  cl_command_queue_properties properties = trace().enabled() ? CL_QUEUE_PROFILING_ENABLE : 0;
+  if (config.out_of_order && supports_out_of_order(engine.device())) {
+    properties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+  }
+  return properties;
+}
+
+size_t gcd(size_t x, size_t y)
+{
+  while (y) {
+    size_t r = x % y;
+    x = y;
+    y = r;
+  }
+  return x;
+}
+
+// The use_host_ptr variant: per-chunk buffers over the host arrays, with
+// at most `depth` chunks in flight.
+StreamResult stream_add_host_ptr(OpenCLEngine& engine, int* c, const int* a, const int* b, size_t N,
+                                 const StreamConfig& config)
+{
+  // Chunks must be whole work groups and keep every chunk start aligned.
+  size_t local_size = engine.local_size();
+  size_t align = std::max(engine.host_alignment() / sizeof(int), (size_t)1);
+  size_t granule = local_size / gcd(local_size, align) * align;
+  size_t chunk = std::max(config.chunk_elements / granule, (size_t)1) * granule;
+
+  std::vector<QueueHandle> queues;
+  std::vector<EventHandle> done;        // per chunk, until waited on
+  TracedEvents traced;
+  FinishQueues finish(queues);
+  for (size_t i = 0; i < config.queues; i++) {
+    queues.push_back(QueueHandle(engine.create_queue(stream_queue_properties(engine, config))));
+  }
+
+  StreamResult result;
+  Timer stream_timer;
+  stream_timer.start();
+  for (size_t begin = 0, k = 0; begin < N; begin += chunk, k++) {
+    size_t count = std::min(chunk, N - begin);
+    size_t bytes = sizeof(int) * count;
+    cl_command_queue queue = queues[k % queues.size()].get();
+
+    // Bound the chunks in flight; the oldest has to finish first.
+    if (k >= config.depth) {
+      EventHandle& oldest = done[k - config.depth];
+      cl_event oldest_event = oldest.get();
+      cl_int err = clWaitForEvents(1, &oldest_event);
+      oldest.reset();
+      check_cl(err, "clWaitForEvents");
+    }
+
+    cl_int err = CL_SUCCESS;
+    MemHandle a_buffer(clCreateBuffer(engine.context(), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, (void*)(a + begin), &err));
+    if (!a_buffer) {
+      throw OpenCLError("clCreateBuffer", err);
+    }
+    MemHandle b_buffer(clCreateBuffer(engine.context(), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, (void*)(b + begin), &err));
+    if (!b_buffer) {
+      throw OpenCLError("clCreateBuffer", err);
+    }
+    MemHandle c_buffer(clCreateBuffer(engine.context(), CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, bytes, c + begin, &err));
+    if (!c_buffer) {
+      throw OpenCLError("clCreateBuffer", err);
+    }
+
+    EventHandle kernel;
+    engine.enqueue_add(queue, c_buffer.get(), a_buffer.get(), b_buffer.get(), count, 0, NULL, kernel.out());
+    traced.keep("kernel", kernel.get());
+
+    // Mapping c is what makes the results visible at c + begin; on
+    // unified-memory devices it is only a cache flush.
+    EventHandle map;
+    cl_event kernel_event = kernel.get();
+    void* mapped = clEnqueueMapBuffer(queue, c_buffer.get(), CL_FALSE, CL_MAP_READ, 0, bytes, 1, &kernel_event,
+                                      map.out(), &err);
+    if (!mapped || err != CL_SUCCESS) {
+      throw OpenCLError("clEnqueueMapBuffer", err);
+    }
+    done.push_back(EventHandle());
+    cl_event map_event = map.get();
+    check_cl(clEnqueueUnmapMemObject(queue, c_buffer.get(), mapped, 1, &map_event, done.back().out()),
+             "clEnqueueUnmapMemObject");
+    traced.keep("unmap c", done.back().get());
+
+    // Released objects live on until the commands using them finish.
+    clFlush(queue);
+    result.chunks++;
+  }
+
+  finish.finish();
+  stream_timer.stop();
+  traced.record();
+
+  result.seconds = stream_timer.elapsed();
+  if (result.seconds > 0.0) {
+    result.gigabytes_per_second = 3.0 * sizeof(int) * N / result.seconds * 1e-9;
+  }
+  return result;
+}
+
+} // namespace
+
+StreamResult stream_add(OpenCLEngine& engine, int* c, const int* a, const int* b, size_t N,
+                        const StreamConfig& config)
+{
+  if (config.depth == 0 || config.queues == 0) {
+    throw std::invalid_argument("stream_add: depth and queues must be non-zero");
+  }
+  if (config.use_host_ptr) {
+    return stream_add_host_ptr(engine, c, a, b, N, config);
+  }
+
+  // Whole-work-group chunks keep padding work-items to the last chunk.
+  size_t local_size = engine.local_size();
+  size_t chunk = std::max(config.chunk_elements / local_size, (size_t)1) * local_size;
+  size_t chunk_bytes = sizeof(int) * chunk;
+
+  BufferPool& pool = engine.pool();
+  std::vector<QueueHandle> queues;
+  std::vector<BufferSet> sets;
+  TracedEvents traced;
+  FinishQueues finish(queues);
+  for (size_t i = 0; i < config.queues; i++) {
+    queues.push_back(QueueHandle(engine.create_queue(stream_queue_properties(engine, config))));
+  }
+  for (size_t i = 0; i < config.depth; i++) {
+    BufferSet set;
+    set.a = PooledBuffer(pool, chunk_bytes, CL_MEM_READ_ONLY);
+    set.b = PooledBuffer(pool, chunk_bytes, CL_MEM_READ_ONLY);
+    set.c = PooledBuffer(pool, chunk_bytes, CL_MEM_WRITE_ONLY);
+    sets.push_back(std::move(set));
+  }
+
+  StreamResult result;
+  Timer stream_timer;
+  stream_timer.start();
+  for (size_t begin = 0, k = 0; begin < N; begin += chunk, k++) {
+    size_t count = std::min(chunk, N - begin);
+    size_t bytes = sizeof(int) * count;
+    BufferSet& set = sets[k % sets.size()];
+    cl_command_queue queue = queues[k % queues.size()].get();
+
+    // The previous chunk in this buffer set may still be on another queue;
+    // the uploads wait for its read-back instead of blocking the host.
+    cl_event previous = set.done.get();
+    cl_uint num_waits = previous ? 1 : 0;
+    EventHandle writes[2], kernel;
+    check_cl(clEnqueueWriteBuffer(queue, set.a.get(), CL_FALSE, 0, bytes, a + begin, num_waits,
+                                  previous ? &previous : NULL, writes[0].out()), "clEnqueueWriteBuffer");
+    check_cl(clEnqueueWriteBuffer(queue, set.b.get(), CL_FALSE, 0, bytes, b + begin, num_waits,
+                                  previous ? &previous : NULL, writes[1].out()), "clEnqueueWriteBuffer");
+    set.done.reset();
+
+    cl_event wait_list[2] = { writes[0].get(), writes[1].get() };
+    engine.enqueue_add(queue, set.c.get(), set.a.get(), set.b.get(), count, 2, wait_list, kernel.out());
+    traced.keep("write a", writes[0].get());
+    traced.keep("write b", writes[1].get());
+    traced.keep("kernel", kernel.get());
+
+    cl_event kernel_event = kernel.get();
+    check_cl(clEnqueueReadBuffer(queue, set.c.get(), CL_FALSE, 0, bytes, c + begin, 1, &kernel_event,
+                                 set.done.out()), "clEnqueueReadBuffer");
+    traced.keep("read c", set.done.get());
+    clFlush(queue);
+    result.chunks++;
+  }
+
+  finish.finish();
+  stream_timer.stop();
+  traced.record();
+
+  result.seconds = stream_timer.elapsed();
+  if (result.seconds > 0.0) {
+    result.gigabytes_per_second = 3.0 * sizeof(int) * N / result.seconds * 1e-9;
+  }
+  return result;
+}
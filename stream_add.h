@@ -0,0 +1,73 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef STREAM_ADD_H__
+#define STREAM_ADD_H__
+
+#include <stddef.h>
+
+class OpenCLEngine;
+
+struct StreamConfig {
+    size_t  chunk_elements; // elements per chunk; rounded to the local size
+    size_t  depth;          // buffer sets in flight (2 or 3 is typical)
+    size_t  queues;         // command queues chunks are spread over
+    bool    use_host_ptr;   // wrap the host arrays instead of copying
+    bool    out_of_order;   // out-of-order queues, where the device has them
+
+    StreamConfig() : chunk_elements(4 * 1024 * 1024), depth(3), queues(2), use_host_ptr(false), out_of_order(false) {}
+};
+
+struct StreamResult {
+    size_t  chunks;
+    double  seconds;
+    double  gigabytes_per_second;   // (a + b + c) bytes moved / seconds
+
+    StreamResult() : chunks(0), seconds(0.0), gigabytes_per_second(0.0) {}
+};
+
+// Computes c = a + b over arrays that need not fit on the device at once.
+// The arrays are split into chunks that cycle through `depth` buffer sets on
+// `queues` command queues, so chunk k + 1 uploads while chunk k runs and
+// chunk k - 1 downloads. Dependencies between chunks sharing a buffer set
+// are expressed with events, not host waits.
+//
+// Every dependency, within a chunk as well, is an event, so the chunks are
+// correct on out-of-order queues too. With `out_of_order`, a single queue
+// can then overlap one chunk's transfers with another's kernel, as several
+// in-order queues do.
+//
+// With `use_host_ptr`, each chunk instead wraps its part of a, b and c in
+// CL_MEM_USE_HOST_PTR buffers and the result is made visible by mapping c.
+// On devices with host-unified memory the kernel then reads and writes the
+// host pages directly (e.g. mmapped files) with no staging copy. The arrays
+// must be aligned to engine.host_alignment(); chunks are rounded so every
+// chunk stays aligned.
+StreamResult stream_add(OpenCLEngine& engine, int* c, const int* a, const int* b, size_t N,
+                        const StreamConfig& config);
+
+#endif // STREAM_ADD_H__
@@ -0,0 +1,144 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "thread_pool.h"
+
+#include <algorithm>
+
+// Set while a thread is executing pool tasks, so nested run() calls from
+// those tasks run inline.
+static thread_local bool t_in_pool = false;
+
+ThreadPool::ThreadPool(size_t threads)
+: m_task(NULL)
+, m_count(0)
+, m_next(0)
+, m_remaining(0)
+, m_generation(0)
+, m_stop(false)
+{
+  if (threads == 0) {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  for (size_t i = 1; i < threads; i++) {
+    m_workers.push_back(std::thread(&ThreadPool::worker, this));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (size_t i = 0; i < m_workers.size(); i++) {
+    m_workers[i].join();
+  }
+}
+
+void ThreadPool::worker()
+{
+  t_in_pool = true;
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_wake.wait(lock, [this, seen]() { return m_stop || m_generation != seen; });
+    if (m_stop) {
+      return;
+    }
+    seen = m_generation;
+    drain(lock);
+  }
+}
+
+// Runs task indices until none are left to hand out. Called with `lock`
+// held; the lock is dropped while a task runs.
+void ThreadPool::drain(std::unique_lock<std::mutex>& lock)
+{
+  while (m_next < m_count) {
+    size_t i = m_next++;
+    const std::function<void(size_t)>& task = *m_task;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      task(i);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if (error && !m_error) {
+      m_error = error;
+    }
+    if (--m_remaining == 0) {
+      m_done.notify_all();
+    }
+  }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task)
+{
+  if (count == 0) {
+    return;
+  }
+  if (t_in_pool || m_workers.empty() || count == 1) {
+    for (size_t i = 0; i < count; i++) {
+      task(i);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> run_lock(m_run_mutex);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_task = &task;
+  m_count = count;
+  m_next = 0;
+  m_remaining = count;
+  m_error = std::exception_ptr();
+  m_generation++;
+  m_wake.notify_all();
+
+  // The caller works too instead of just waiting.
+  t_in_pool = true;
+  drain(lock);
+  t_in_pool = false;
+  m_done.wait(lock, [this]() { return m_remaining == 0; });
+
+  m_task = NULL;
+  std::exception_ptr error = m_error;
+  m_error = std::exception_ptr();
+  lock.unlock();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+ThreadPool& host_thread_pool()
+{
+  static ThreadPool pool;
+  return pool;
+}
@@ -0,0 +1,83 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef THREAD_POOL_H__
+#define THREAD_POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run index-parallel tasks. Workers are
+// started once and sleep between tasks, so short parallel loops don't pay
+// for thread creation every time.
+class ThreadPool {
+protected:
+    std::vector<std::thread>            m_workers;
+    std::mutex                          m_run_mutex;    // one run() at a time
+    std::mutex                          m_mutex;
+    std::condition_variable             m_wake;
+    std::condition_variable             m_done;
+    const std::function<void(size_t)>*  m_task;
+    size_t                              m_count;
+    size_t                              m_next;         // next index to hand out
+    size_t                              m_remaining;    // indices not yet finished
+    uint64_t                            m_generation;   // bumped per run()
+    std::exception_ptr                  m_error;
+    bool                                m_stop;
+
+    void worker();
+    void drain(std::unique_lock<std::mutex>& lock);
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+public:
+    // `threads` counts the calling thread, which also works during run();
+    // 0 means one per hardware thread.
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    // Threads that take part in run(), including the caller.
+    size_t size() const { return m_workers.size() + 1; }
+
+    // Calls task(i) for every i in [0, count) across the pool and returns
+    // when all have finished, rethrowing the first exception a task threw.
+    // Calls from inside a task run inline rather than deadlocking.
+    void run(size_t count, const std::function<void(size_t)>& task);
+};
+
+// The process-wide pool used by parallel_for(), created on first use.
+ThreadPool& host_thread_pool();
+
+#endif // THREAD_POOL_H__
@@ -26,12 +26,18 @@
 */
 
 #include "timer.h"
-#include <sys/time.h>
-#include <stdlib.h>
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 
 Timer::Timer()
-: m_start(0.0)
-, m_stop(0.0)
+: m_start(0)
+, m_stop(0)
+, m_lap(0)
+, m_total(0)
+, m_running(false)
 {
 }
 
@@ -39,25 +45,147 @@ Timer::~Timer()
 {
 }
 
-double Timer::now() const
+int64_t Timer::now()
 {
-  timeval   tv;
-  
-  gettimeofday( &tv, NULL );
-  return ( double )tv.tv_sec + ( double )tv.tv_usec * 1.e-6;
+  // steady_clock never jumps when the system time is adjusted, unlike
+  // gettimeofday().
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 void Timer::start()
 {
   m_start = now();
+  m_lap = m_start;
+  m_running = true;
 }
 
 void Timer::stop()
 {
   m_stop = now();
+  if (m_running) {
+    m_total += m_stop - m_start;
+    m_running = false;
+  }
+}
+
+void Timer::reset()
+{
+  m_start = m_stop = m_lap = 0;
+  m_total = 0;
+  m_running = false;
+}
+
+int64_t Timer::elapsed_ns() const
+{
+  return (m_running ? now() : m_stop) - m_start;
 }
 
 double Timer::elapsed() const
 {
-  return m_stop - m_start;
+  return elapsed_ns() * 1e-9;
+}
+
+double Timer::lap()
+{
+  int64_t time = now();
+  int64_t lap = time - m_lap;
+  m_lap = time;
+  return lap * 1e-9;
+}
+
+int64_t Timer::total_ns() const
+{
+  return m_total + (m_running ? now() - m_start : 0);
+}
+
+double Timer::total() const
+{
+  return total_ns() * 1e-9;
+}
+
+SampleStats::SampleStats()
+: m_sorted_valid(true)
+{
+}
+
+SampleStats::~SampleStats()
+{
+}
+
+void SampleStats::add(double sample)
+{
+  m_samples.push_back(sample);
+  m_sorted_valid = false;
+}
+
+void SampleStats::clear()
+{
+  m_samples.clear();
+  m_sorted.clear();
+  m_sorted_valid = true;
+}
+
+const std::vector<double>& SampleStats::sorted() const
+{
+  if (m_samples.empty()) {
+    throw std::logic_error("SampleStats: no samples");
+  }
+  if (!m_sorted_valid) {
+    m_sorted = m_samples;
+    std::sort(m_sorted.begin(), m_sorted.end());
+    m_sorted_valid = true;
+  }
+  return m_sorted;
+}
+
+double SampleStats::min() const
+{
+  return sorted().front();
+}
+
+double SampleStats::max() const
+{
+  return sorted().back();
+}
+
+double SampleStats::mean() const
+{
+  if (m_samples.empty()) {
+    throw std::logic_error("SampleStats: no samples");
+  }
+  double sum = 0.0;
+  for (size_t i = 0; i < m_samples.size(); i++) {
+    sum += m_samples[i];
+  }
+  return sum / m_samples.size();
+}
+
+double SampleStats::stddev() const
+{
+  if (m_samples.size() < 2) {
+    return 0.0;
+  }
+  double average = mean();
+  double sum_squares = 0.0;
+  for (size_t i = 0; i < m_samples.size(); i++) {
+    double delta = m_samples[i] - average;
+    sum_squares += delta * delta;
+  }
+  return sqrt(sum_squares / (m_samples.size() - 1));
+}
+
+double SampleStats::median() const
+{
+  return percentile(50.0);
+}
+
+double SampleStats::percentile(double p) const
+{
+  const std::vector<double>& values = sorted();
+  double rank = std::min(std::max(p, 0.0), 100.0) / 100.0 * (values.size() - 1);
+  size_t lower = (size_t)rank;
+  size_t upper = std::min(lower + 1, values.size() - 1);
+  double fraction = rank - lower;
+  return values[lower] + (values[upper] - values[lower]) * fraction;
 }
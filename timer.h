@@ -28,21 +28,79 @@
 #ifndef BASE_TIMER_H__
 #define BASE_TIMER_H__
 
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Wall-clock timer on a monotonic, high-resolution clock, kept in
+// nanoseconds. Each start()/stop() pair is one interval; intervals also
+// accumulate into total() until reset(), and lap() reads split times
+// without stopping.
 class Timer {
 protected:
-    double  m_start;
-    double  m_stop;
-    
-    double  now() const;
+    int64_t m_start;
+    int64_t m_stop;
+    int64_t m_lap;
+    int64_t m_total;
+    bool    m_running;
 
 public:
     Timer();
     ~Timer();
+
+    // The clock reading in nanoseconds from an arbitrary epoch; only
+    // differences between readings mean anything.
+    static int64_t now();
     
     void start();
     void stop();
+
+    // Clears the accumulated total and stops the timer.
+    void reset();
+
+    // The last interval in seconds; while running, the time since start().
     double elapsed() const;
+    int64_t elapsed_ns() const;
+
+    // Seconds since start() or the previous lap(), whichever is later.
+    double lap();
+
+    // Sum of all intervals since construction or reset(), in seconds.
+    double total() const;
+    int64_t total_ns() const;
 };
 
-#endif // BASE_TIMER_H__
+// Collects repeated measurements (e.g. seconds per run) and summarises
+// their distribution. All statistics are of the samples added so far and
+// require at least one sample.
+class SampleStats {
+protected:
+    std::vector<double>         m_samples;
+    mutable std::vector<double> m_sorted;
+    mutable bool                m_sorted_valid;
 
+    const std::vector<double>& sorted() const;
+
+public:
+    SampleStats();
+    ~SampleStats();
+
+    void add(double sample);
+    void clear();
+
+    size_t count() const { return m_samples.size(); }
+    const std::vector<double>& samples() const { return m_samples; }
+
+    double min() const;
+    double max() const;
+    double mean() const;
+    double stddev() const;      // sample standard deviation (n - 1)
+    double median() const;
+
+    // `p` in [0, 100], linearly interpolated between the nearest samples.
+    double percentile(double p) const;
+    double p95() const { return percentile(95.0); }
+    double p99() const { return percentile(99.0); }
+};
+
+#endif // BASE_TIMER_H__
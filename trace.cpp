@@ -0,0 +1,209 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "trace.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+// Names are our own literals and device names, but escape anyway so the
+// file always parses.
+std::string json_escape(const std::string& value)
+{
+  std::string escaped;
+  for (size_t i = 0; i < value.size(); i++) {
+    unsigned char ch = (unsigned char)value[i];
+    if (ch == '"' || ch == '\\') {
+      escaped += '\\';
+      escaped += (char)ch;
+    } else if (ch >= 0x20) {
+      escaped += (char)ch;
+    }
+  }
+  return escaped;
+}
+
+std::string device_name(cl_device_id device)
+{
+  char name[256] = { 0 };
+  if (clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL) != CL_SUCCESS) {
+    return "device";
+  }
+  return name;
+}
+
+} // namespace
+
+Trace::Trace()
+: m_enabled(false)
+{
+}
+
+Trace::~Trace()
+{
+}
+
+size_t Trace::thread_track_locked()
+{
+  std::thread::id id = std::this_thread::get_id();
+  std::map<std::thread::id, size_t>::iterator found = m_threads.find(id);
+  if (found != m_threads.end()) {
+    return found->second;
+  }
+  size_t track = m_threads.size();
+  m_threads[id] = track;
+  return track;
+}
+
+void Trace::host_span(const char* name, const char* category, int64_t start_ns, int64_t end_ns)
+{
+  if (!enabled()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Span span = { name, category, NULL, thread_track_locked(), start_ns, end_ns };
+  m_spans.push_back(span);
+}
+
+void Trace::device_span(const char* name, const char* category, cl_event event)
+{
+  if (!enabled() || !event) {
+    return;
+  }
+  int64_t host_now = Timer::now();
+
+  cl_ulong start = 0;
+  cl_ulong end = 0;
+  cl_command_queue queue = NULL;
+  cl_device_id device = NULL;
+  if (clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) != CL_SUCCESS ||
+      clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) != CL_SUCCESS ||
+      clGetEventInfo(event, CL_EVENT_COMMAND_QUEUE, sizeof(queue), &queue, NULL) != CL_SUCCESS ||
+      clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL) != CL_SUCCESS) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (std::find(m_devices.begin(), m_devices.end(), device) == m_devices.end()) {
+    m_devices.push_back(device);
+  }
+  std::map<cl_command_queue, size_t>::iterator found = m_queues.find(queue);
+  if (found == m_queues.end()) {
+    found = m_queues.insert(std::make_pair(queue, m_queue_devices.size())).first;
+    m_queue_devices.push_back(device);
+  }
+
+  int64_t offset = host_now - (int64_t)end;
+  std::map<cl_device_id, int64_t>::iterator device_offset = m_device_offsets.find(device);
+  if (device_offset == m_device_offsets.end()) {
+    m_device_offsets[device] = offset;
+  } else {
+    device_offset->second = std::min(device_offset->second, offset);
+  }
+
+  Span span = { name, category, device, found->second, (int64_t)start, (int64_t)end };
+  m_spans.push_back(span);
+}
+
+void Trace::write(std::ostream& out) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Spans in host nanoseconds, with the earliest at zero.
+  std::vector<std::pair<int64_t, int64_t> > times;
+  int64_t origin = std::numeric_limits<int64_t>::max();
+  for (size_t i = 0; i < m_spans.size(); i++) {
+    const Span& span = m_spans[i];
+    int64_t offset = span.device ? m_device_offsets.find(span.device)->second : 0;
+    times.push_back(std::make_pair(span.start_ns + offset, span.end_ns + offset));
+    origin = std::min(origin, times.back().first);
+  }
+
+  // The host is process 0 and each device the process after its index.
+  std::vector<std::string> events;
+  events.push_back("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"host\"}}");
+  for (size_t i = 0; i < m_devices.size(); i++) {
+    events.push_back("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + std::to_string(i + 1) +
+                     ",\"args\":{\"name\":\"" + json_escape(device_name(m_devices[i])) + "\"}}");
+  }
+  for (size_t i = 0; i < m_threads.size(); i++) {
+    events.push_back("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" + std::to_string(i) +
+                     ",\"args\":{\"name\":\"thread " + std::to_string(i) + "\"}}");
+  }
+
+  for (size_t i = 0; i < m_queue_devices.size(); i++) {
+    size_t pid = std::find(m_devices.begin(), m_devices.end(), m_queue_devices[i]) - m_devices.begin() + 1;
+    events.push_back("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + std::to_string(pid) + ",\"tid\":" +
+                     std::to_string(i) + ",\"args\":{\"name\":\"queue " + std::to_string(i) + "\"}}");
+  }
+
+  for (size_t i = 0; i < m_spans.size(); i++) {
+    const Span& span = m_spans[i];
+    size_t pid = 0;
+    if (span.device) {
+      pid = std::find(m_devices.begin(), m_devices.end(), span.device) - m_devices.begin() + 1;
+    }
+    std::ostringstream event;
+    event << std::fixed << std::setprecision(3)
+          << "{\"name\":\"" << json_escape(span.name) << "\",\"cat\":\"" << json_escape(span.category)
+          << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << span.track
+          << ",\"ts\":" << (times[i].first - origin) * 1e-3
+          << ",\"dur\":" << (times[i].second - times[i].first) * 1e-3 << "}";
+    events.push_back(event.str());
+  }
+
+  out << "{\"traceEvents\":[" << std::endl;
+  for (size_t i = 0; i < events.size(); i++) {
+    out << "  " << events[i] << (i + 1 < events.size() ? "," : "") << std::endl;
+  }
+  out << "],\"displayTimeUnit\":\"ns\"}" << std::endl;
+}
+
+Trace& trace()
+{
+  static Trace instance;
+  return instance;
+}
+
+TraceScope::TraceScope(const char* name, const char* category)
+: m_name(name)
+, m_category(category)
+, m_start_ns(trace().enabled() ? Timer::now() : 0)
+{
+}
+
+TraceScope::~TraceScope()
+{
+  if (m_start_ns != 0) {
+    trace().host_span(m_name, m_category, m_start_ns, Timer::now());
+  }
+}
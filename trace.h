@@ -0,0 +1,121 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <OpenCL/opencl.h>
+
+// Records where the time goes as spans and writes them in the Chrome trace
+// event format, which chrome://tracing and ui.perfetto.dev open. Host spans
+// are timed on Timer's clock, one track per thread. Device spans come from
+// profiling events, one process per device and one track per command queue,
+// so overlap between queues and devices is visible.
+//
+// Device timestamps are on the device's own clock. They are mapped onto
+// host time with a per-device offset: a span is recorded only after its
+// event has completed, so the host clock then is an upper bound for the
+// event's end, and the tightest bound seen over the run is used.
+//
+// Recording is off until enable(); until then every call returns after one
+// relaxed load.
+class Trace {
+protected:
+    struct Span {
+        const char*         name;
+        const char*         category;
+        cl_device_id        device;     // NULL for host spans
+        size_t              track;      // thread or queue index
+        int64_t             start_ns;   // host clock, or device clock
+        int64_t             end_ns;
+    };
+
+    std::atomic<bool>                           m_enabled;
+    mutable std::mutex                          m_mutex;
+    std::vector<Span>                           m_spans;
+    std::map<std::thread::id, size_t>           m_threads;
+    std::vector<cl_device_id>                   m_devices;
+    std::map<cl_command_queue, size_t>          m_queues;           // to track
+    std::vector<cl_device_id>                   m_queue_devices;    // by track
+    std::map<cl_device_id, int64_t>             m_device_offsets;   // host - device ns
+
+    size_t thread_track_locked();
+
+private:
+    Trace(const Trace&);
+    Trace& operator=(const Trace&);
+
+public:
+    Trace();
+    ~Trace();
+
+    void enable() { m_enabled.store(true); }
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // A span on the calling thread's track between two Timer::now()
+    // readings. `name` and `category` must outlive the trace, e.g. string
+    // literals; the same goes for device_span().
+    void host_span(const char* name, const char* category, int64_t start_ns, int64_t end_ns);
+
+    // A span for the command behind `event`, which must have completed on a
+    // queue created with CL_QUEUE_PROFILING_ENABLE; other events are
+    // skipped. The device and queue are taken from the event.
+    void device_span(const char* name, const char* category, cl_event event);
+
+    // Writes everything recorded so far as a JSON trace.
+    void write(std::ostream& out) const;
+};
+
+// The process-wide trace that the engine and the add paths record into.
+Trace& trace();
+
+// Records a host span for its own lifetime. `name` and `category` must
+// outlive it, e.g. string literals.
+class TraceScope {
+protected:
+    const char* m_name;
+    const char* m_category;
+    int64_t     m_start_ns;
+
+private:
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+
+public:
+    TraceScope(const char* name, const char* category);
+    ~TraceScope();
+};
+
+#endif // TRACE_H__
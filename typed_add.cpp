@@ -0,0 +1,102 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#include "typed_add.h"
+
+#include <stdint.h>
+#include <string.h>
+
+Half float_to_half(float value)
+{
+  uint32_t f = 0;
+  memcpy(&f, &value, sizeof(f));
+  uint32_t sign = (f >> 16) & 0x8000;
+  int32_t exponent = (int32_t)((f >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = f & 0x7fffff;
+
+  Half half;
+  if (((f >> 23) & 0xff) == 0xff) {
+    // Infinity stays infinity; NaN keeps a quiet NaN payload.
+    half.bits = (cl_half)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  } else if (exponent >= 0x1f) {
+    half.bits = (cl_half)(sign | 0x7c00);
+  } else if (exponent <= 0) {
+    if (exponent < -10) {
+      half.bits = (cl_half)sign;
+    } else {
+      // Subnormal: shift the implicit bit in, then round to nearest even.
+      mantissa |= 0x800000;
+      uint32_t shift = (uint32_t)(14 - exponent);
+      uint32_t rounded = mantissa >> shift;
+      uint32_t remainder = mantissa & ((1u << shift) - 1);
+      uint32_t halfway = 1u << (shift - 1);
+      if (remainder > halfway || (remainder == halfway && (rounded & 1))) {
+        rounded++;
+      }
+      half.bits = (cl_half)(sign | rounded);
+    }
+  } else {
+    uint32_t rounded = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (rounded & 1))) {
+      // May carry into the exponent, up to infinity, which is correct.
+      rounded++;
+    }
+    half.bits = (cl_half)(sign | rounded);
+  }
+  return half;
+}
+
+float half_to_float(Half value)
+{
+  uint32_t sign = (uint32_t)(value.bits & 0x8000) << 16;
+  uint32_t exponent = (value.bits >> 10) & 0x1f;
+  uint32_t mantissa = value.bits & 0x3ff;
+
+  uint32_t f = 0;
+  if (exponent == 0x1f) {
+    f = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent == 0) {
+    if (mantissa == 0) {
+      f = sign;
+    } else {
+      // Renormalize the subnormal.
+      exponent = 127 - 15 + 1;
+      while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        exponent--;
+      }
+      f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  } else {
+    f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+
+  float result = 0.0f;
+  memcpy(&result, &f, sizeof(result));
+  return result;
+}
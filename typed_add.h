@@ -0,0 +1,105 @@
+/*
+  This is free and unencumbered software released into the public domain.
+
+  Anyone is free to copy, modify, publish, use, compile, sell, or
+  distribute this software, either in source code form or as a compiled
+  binary, for any purpose, commercial or non-commercial, and by any
+  means.
+
+  In jurisdictions that recognize copyright laws, the author or authors
+  of this software dedicate any and all copyright interest in the
+  software to the public domain. We make this dedication for the benefit
+  of the public at large and to the detriment of our heirs and
+  successors. We intend this dedication to be an overt act of
+  relinquishment in perpetuity of all present and future rights to this
+  software under copyright law.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+  OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+
+  For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef TYPED_ADD_H__
+#define TYPED_ADD_H__
+
+#include <stddef.h>
+#include <stdexcept>
+#include <string>
+#include <OpenCL/opencl.h>
+
+#include "opencl_engine.h"
+
+// IEEE 754 binary16, stored as its bit pattern. cl_half is only a typedef
+// for an unsigned short, so it needs a distinct type to select add_typed
+// with half storage instead of ushort.
+struct Half {
+    cl_half bits;
+};
+
+// Round-to-nearest-even conversions between float and Half.
+Half float_to_half(float value);
+float half_to_float(Half value);
+
+// Maps a host element type to its OpenCL C type for -DT=. Only the
+// specializations below exist, so add_opencl<T>() with anything else fails
+// to compile.
+template <typename T> struct DeviceType;
+
+#define DEVICE_TYPE(host_type, cl_name, integer)                \
+    template <> struct DeviceType<host_type> {                  \
+        static const char* name() { return cl_name; }           \
+        static const bool is_integer = integer;                 \
+    }
+
+DEVICE_TYPE(cl_char, "char", true);
+DEVICE_TYPE(cl_uchar, "uchar", true);
+DEVICE_TYPE(cl_short, "short", true);
+DEVICE_TYPE(cl_ushort, "ushort", true);
+DEVICE_TYPE(cl_int, "int", true);
+DEVICE_TYPE(cl_uint, "uint", true);
+DEVICE_TYPE(cl_long, "long", true);
+DEVICE_TYPE(cl_ulong, "ulong", true);
+DEVICE_TYPE(cl_float, "float", false);
+DEVICE_TYPE(cl_double, "double", false);
+DEVICE_TYPE(Half, "half", false);
+
+#undef DEVICE_TYPE
+
+// Build options selecting add_typed for T. `saturate` clamps integer sums to
+// the type's range instead of wrapping; it is an error for floating types.
+template <typename T>
+std::string typed_add_options(bool saturate)
+{
+  if (saturate && !DeviceType<T>::is_integer) {
+    throw std::invalid_argument("typed_add_options: saturation needs an integer type");
+  }
+  std::string name = DeviceType<T>::name();
+  std::string options = "-DT=" + name;
+  if (saturate) {
+    options += " -DSATURATE";
+  }
+  if (name == "double") {
+    options += " -DUSE_FP64";
+  } else if (name == "half") {
+    options += " -DHALF_STORAGE";
+  }
+  return options;
+}
+
+// c = a + b over N elements of T, through a kernel built for T (one program
+// per type and saturation mode, shared through the program cache). Returns
+// the kernel execution time in seconds, like OpenCLEngine::add().
+template <typename T>
+double add_opencl(OpenCLEngine& engine, T* c, const T* a, const T* b, size_t N, bool saturate = false,
+                  AddProfile* profile = NULL)
+{
+  return engine.add_typed(typed_add_options<T>(saturate), sizeof(T), c, a, b, N, profile);
+}
+
+#endif // TYPED_ADD_H__